@@ -0,0 +1,36 @@
+#!/bin/sh
+# Run each program given with every engine, and as compiled by lambdac, and fail if any of
+# them prints differently from the default engine. Only what is printed to standard output
+# is compared, as warnings are the interpreter's own. Run from lambda/, with the path of
+# each program from there, without `.lambda`, followed by the path of its compiled binary.
+#
+# Usage: check.sh program binary [program binary]...
+
+status=0
+expected=$(mktemp)
+actual=$(mktemp)
+
+while [ $# -ge 2 ]; do
+    program=$1
+    binary=$2
+    shift 2
+
+    ../bin/main -r "$program" > "$expected" 2> /dev/null
+
+    for engine in -g -m -b -p -l lambdac; do
+        if [ $engine = lambdac ]; then "$binary" > "$actual" 2> /dev/null
+        else ../bin/main $engine -r "$program" > "$actual" 2> /dev/null
+        fi
+
+        if diff -u "$expected" "$actual" > /dev/null; then
+            echo "ok      $program $engine"
+        else
+            echo "FAILED  $program $engine"
+            diff -u --label default --label "$engine" "$expected" "$actual"
+            status=1
+        fi
+    done
+done
+
+rm -f "$expected" "$actual"
+exit $status
@@ -0,0 +1,90 @@
+#include <algorithm>
+#include <memory>
+
+#include "headers/arena.hpp"
+
+namespace LambdaCalc
+{
+
+static thread_local Arena* currentArena = nullptr;
+
+Arena* Arena::current()
+{ return currentArena; }
+
+Arena::Scope::Scope(Arena* arena) : previous(currentArena)
+{ currentArena = arena; }
+
+Arena::Scope::~Scope()
+{ currentArena = previous; }
+
+void* Arena::allocate(std::size_t size)
+{
+    size = roundUp(std::max<std::size_t>(size, sizeof(FreeBlock)));
+
+    allocatedBytes += size;
+    allocationCount++;
+
+    if (size <= maxRecycledSize)
+    if (auto& freeList = freeLists[size / alignment]; freeList)
+    {
+        void* ptr = freeList;
+        freeList = freeList->next;
+        return ptr;
+    }
+
+    while (static_cast<std::size_t>(end - next) < size)
+    {
+        if (block + 1 < blocks.size()) block++;
+        else
+        {
+            std::size_t newSize = std::max(blockSize, size);
+            blocks.push_back(std::unique_ptr<std::byte[]>(new std::byte[newSize]));
+            blockSizes.push_back(newSize);
+            block = blocks.size() - 1;
+        }
+
+        next = blocks[block].get();
+        end = next + blockSizes[block];
+    }
+
+    void* ptr = next;
+    next += size;
+    return ptr;
+}
+
+void Arena::deallocate(void* ptr, std::size_t size)
+{
+    size = roundUp(std::max<std::size_t>(size, sizeof(FreeBlock)));
+    if (size > maxRecycledSize) return;
+
+    auto& freeList = freeLists[size / alignment];
+    freeList = new (ptr) FreeBlock { freeList };
+}
+
+void Arena::reset()
+{
+    // Keep the first block for the next evaluation, but give back the rest
+    if (blocks.size() > 1)
+    {
+        blocks.resize(1);
+        blockSizes.resize(1);
+    }
+
+    block = 0;
+    next = blocks.empty() ? nullptr : blocks[0].get();
+    end = blocks.empty() ? nullptr : next + blockSizes[0];
+
+    std::fill(std::begin(freeLists), std::end(freeLists), nullptr);
+
+    allocatedBytes = 0;
+    allocationCount = 0;
+}
+
+std::size_t Arena::bytesReserved() const
+{
+    std::size_t total = 0;
+    for (const auto& size : blockSizes) total += size;
+    return total;
+}
+
+}
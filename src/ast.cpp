@@ -1,6 +1,8 @@
 #include <memory>
 #include <string>
+#include <vector>
 
+#include "headers/arena.hpp"
 #include "headers/util.hpp"
 #include "headers/ast.hpp"
 
@@ -10,35 +12,154 @@
 namespace LambdaCalc::AST
 {
 
-std::unique_ptr<ApplicationExpr> ApplicationExpr::leftAppendSimpleExpr(
-    std::unique_ptr<SimpleExpr> leftExpr,
-    std::unique_ptr<Expression> rightExpr
-) {
-    if (auto appExpr = dynamic_pointer_cast<ApplicationExpr>(std::move(rightExpr)))
-    {
-        appExpr->left = leftAppendSimpleExpr(std::move(leftExpr), std::move(appExpr->left));
-        return appExpr;
-    }
-    else if (auto rightSimpExpr = dynamic_pointer_cast<SimpleExpr>(std::move(rightExpr)))
-        return std::make_unique<ApplicationExpr>(std::move(leftExpr), std::move(rightSimpExpr));
-    else
-    {
-        return leftAppendSimpleExpr(
-            std::move(leftExpr),
-            std::make_unique<AST::BracketExpr>(std::move(rightExpr))
-        );
-    }
+/// Each node is prefixed with the arena it was allocated in, or nullptr for the heap
+static constexpr std::size_t arena_header_size = Arena::alignment;
+
+void* Line::operator new(std::size_t size)
+{
+    Arena* arena = Arena::current();
+    void* block = arena
+        ? arena->allocate(size + arena_header_size)
+        : ::operator new(size + arena_header_size);
+
+    *static_cast<Arena**>(block) = arena;
+    return static_cast<std::byte*>(block) + arena_header_size;
 }
 
-std::string Comment::toString() const
-{ return ""; }
+void Line::operator delete(void* ptr, std::size_t size)
+{
+    void* block = static_cast<std::byte*>(ptr) - arena_header_size;
+    Arena* arena = *static_cast<Arena**>(block);
+
+    if (arena) arena->deallocate(block, size + arena_header_size);
+    else ::operator delete(block);
+}
+
+std::shared_ptr<const SimpleExpr> SimpleExpr::wrap(ExpressionPtr expr)
+{
+    if (auto simpleExpr = std::dynamic_pointer_cast<const SimpleExpr>(expr))
+        return simpleExpr;
+    return make_arena_shared<BracketExpr>(std::move(expr));
+}
+
+ExpressionPtr WhereExpr::deepCopy() const
+{
+    return make_arena_shared<WhereExpr>(
+        expr->deepCopy(),
+        make_arena_shared<Binding>(binding->from, binding->to->deepCopy())
+    );
+}
+
+ExpressionPtr LetExpr::deepCopy() const
+{
+    return make_arena_shared<LetExpr>(
+        make_arena_shared<Binding>(binding->from, binding->to->deepCopy()),
+        expr->deepCopy()
+    );
+}
+
+ExpressionPtr ApplicationExpr::deepCopy() const
+{
+    return make_arena_shared<ApplicationExpr>(
+        left->deepCopy(),
+        std::static_pointer_cast<const SimpleExpr>(right->deepCopy())
+    );
+}
+
+ExpressionPtr Name::deepCopy() const
+{ return make_arena_shared<Name>(name); }
+
+ExpressionPtr String::deepCopy() const
+{ return make_arena_shared<String>(str.flatten()); }
+
+ExpressionPtr BracketExpr::deepCopy() const
+{ return make_arena_shared<BracketExpr>(expr->deepCopy()); }
+
+ExpressionPtr Mapping::deepCopy() const
+{ return make_arena_shared<Mapping>(from, to->deepCopy()); }
+
+ExpressionPtr Builtin::deepCopy() const
+{
+    std::vector<std::shared_ptr<const SimpleExpr>> copies;
+    for (const auto& arg : args)
+        copies.push_back(std::static_pointer_cast<const SimpleExpr>(arg->deepCopy()));
+    return make_arena_shared<Builtin>(primitive, std::move(copies));
+}
+
+bool isKeyword(Symbol symbol)
+{
+    const static Symbol let("let"), in("in"), where("where");
+    return symbol == let || symbol == in || symbol == where;
+}
+
+WhereExpr::WhereExpr(
+    ExpressionPtr expr,
+    std::shared_ptr<const Binding> binding
+) : expr(std::move(expr)),
+    binding(std::move(binding))
+{ freeNames = freeNamesOf(this->expr.get()) | freeNamesOf(this->binding->to.get()); }
+
+LetExpr::LetExpr(
+    std::shared_ptr<const Binding> binding,
+    ExpressionPtr expr
+) : binding(std::move(binding)),
+    expr(std::move(expr))
+{ freeNames = freeNamesOf(this->binding->to.get()) | freeNamesOf(this->expr.get()); }
+
+ApplicationExpr::ApplicationExpr(
+    ExpressionPtr left,
+    std::shared_ptr<const SimpleExpr> right
+) : left(std::move(left)),
+    right(std::move(right))
+{ freeNames = freeNamesOf(this->left.get()) | freeNamesOf(this->right.get()); }
+
+Builtin::Builtin(
+    const Builtins::Primitive* primitive,
+    std::vector<std::shared_ptr<const SimpleExpr>> args
+) : primitive(primitive),
+    args(std::move(args))
+{ for (const auto& arg : this->args) freeNames |= freeNamesOf(arg.get()); }
 
-ApplicationExpr::ApplicationExpr(const ApplicationExpr& other)
+std::shared_ptr<const Builtin> Builtin::apply(std::shared_ptr<const SimpleExpr> arg) const
 {
-    left = other.left->getExpressionCopy();
-    right = dynamic_pointer_cast<SimpleExpr>(other.right->getExpressionCopy());
+    auto applied = args;
+    applied.push_back(std::move(arg));
+    return make_arena_shared<Builtin>(primitive, std::move(applied));
 }
 
+WhereExpr::~WhereExpr()
+{
+    release(std::move(expr));
+    release(std::move(binding));
+}
+
+LetExpr::~LetExpr()
+{
+    release(std::move(binding));
+    release(std::move(expr));
+}
+
+ApplicationExpr::~ApplicationExpr()
+{
+    release(std::move(left));
+    release(std::move(right));
+}
+
+BracketExpr::~BracketExpr()
+{ release(std::move(expr)); }
+
+Binding::~Binding()
+{ release(std::move(to)); }
+
+Mapping::~Mapping()
+{ release(std::move(to)); }
+
+Builtin::~Builtin()
+{ for (auto& arg : args) release(std::move(arg)); }
+
+std::string Comment::toString() const
+{ return ""; }
+
 std::string Include::toString() const
 #ifdef DEBUG_AST_STRUCTURE
 { return " Include( "+"#include "+name+" )Include "; }
@@ -46,48 +167,98 @@ std::string Include::toString() const
 { return "#include "+name; }
 #endif
 
-std::string LetExpr::toString() const
+std::string BuiltinDecl::toString() const
 #ifdef DEBUG_AST_STRUCTURE
-{ return " LetExpr( let "+binding->toString()+" in "+expr->toString()+" )LetExpr "; }
+{ return " BuiltinDecl( #builtin "+name.str()+" )BuiltinDecl "; }
 #else
-{ return "let "+binding->toString()+" in "+expr->toString(); }
+{ return "#builtin "+name.str(); }
 #endif
 
-std::string WhereExpr::toString() const
+std::string Expression::toString() const
+{
+    std::string result;
+    std::vector<Piece> stack { { {}, this } };
+    std::vector<Piece> children;
+
+    while (!stack.empty())
+    {
+        auto piece = stack.back();
+        stack.pop_back();
+
+        if (!piece.expr)
+        {
+            result += piece.text;
+            continue;
+        }
+
+        children.clear();
+        piece.expr->pieces(children);
+        stack.insert(stack.end(), children.rbegin(), children.rend());
+    }
+
+    return result;
+}
+
+void LetExpr::pieces(std::vector<Piece>& out) const
+#ifdef DEBUG_AST_STRUCTURE
+{ out.insert(out.end(), { { " LetExpr( let " }, { {}, &binding->from }, { " = " }, { {}, binding->to.get() }, { " in " }, { {}, expr.get() }, { " )LetExpr " } }); }
+#else
+{ out.insert(out.end(), { { "let " }, { {}, &binding->from }, { " = " }, { {}, binding->to.get() }, { " in " }, { {}, expr.get() } }); }
+#endif
+
+void WhereExpr::pieces(std::vector<Piece>& out) const
 #ifdef DEBUG_AST_STRUCTURE
-{ return " WhereExpr( "+expr->toString()+" where "+binding->toString()+" )WhereExpr "; }
+{ out.insert(out.end(), { { " WhereExpr( " }, { {}, expr.get() }, { " where " }, { {}, &binding->from }, { " = " }, { {}, binding->to.get() }, { " )WhereExpr " } }); }
 #else
-{ return expr->toString()+" where "+binding->toString(); }
+{ out.insert(out.end(), { { {}, expr.get() }, { " where " }, { {}, &binding->from }, { " = " }, { {}, binding->to.get() } }); }
 #endif
 
-std::string ApplicationExpr::toString() const
+void ApplicationExpr::pieces(std::vector<Piece>& out) const
 #ifdef DEBUG_AST_STRUCTURE
-{ return " AppExpr( "+left->toString()+" "+right->toString()+" )AppExpr "; }
+{ out.insert(out.end(), { { " AppExpr( " }, { {}, left.get() }, { " " }, { {}, right.get() }, { " )AppExpr " } }); }
 #else
-{ return left->toString()+" "+right->toString(); }
+{ out.insert(out.end(), { { {}, left.get() }, { " " }, { {}, right.get() } }); }
 #endif
 
-std::string Name::toString() const
+void Name::pieces(std::vector<Piece>& out) const
 #ifdef DEBUG_AST_STRUCTURE
-{ return " Name( "+name+" )Name "; }
+{ out.insert(out.end(), { { " Name( " }, { name.str() }, { " )Name " } }); }
 #else
-{ return name; }
+{ out.push_back({ name.str() }); }
 #endif
 
-std::string String::toString() const
+void String::pieces(std::vector<Piece>& out) const
+{
 #ifdef DEBUG_AST_STRUCTURE
-{ return " String( \""+str+"\" )String "; }
+    out.push_back({ " String( \"" });
+    str.forEachSegment([&](std::string_view text) { out.push_back({ text }); });
+    out.push_back({ "\" )String " });
 #else
-{ return '\"'+str+'\"'; }
+    out.push_back({ "\"" });
+    str.forEachSegment([&](std::string_view text) { out.push_back({ text }); });
+    out.push_back({ "\"" });
 #endif
+}
 
-std::string BracketExpr::toString() const
+void BracketExpr::pieces(std::vector<Piece>& out) const
 #ifdef DEBUG_AST_STRUCTURE
-{ return " BracketExpr( "+expr->toString()+" )BracketExpr "; }
+{ out.insert(out.end(), { { " BracketExpr( " }, { {}, expr.get() }, { " )BracketExpr " } }); }
 #else
-{ return '('+expr->toString()+')'; }
+{ out.insert(out.end(), { { "(" }, { {}, expr.get() }, { ")" } }); }
 #endif
 
+void Builtin::pieces(std::vector<Piece>& out) const
+{
+#ifdef DEBUG_AST_STRUCTURE
+    out.insert(out.end(), { { " Builtin( " }, { primitive->name.str() } });
+    for (const auto& arg : args) out.insert(out.end(), { { " " }, { {}, arg.get() } });
+    out.push_back({ " )Builtin " });
+#else
+    out.push_back({ primitive->name.str() });
+    for (const auto& arg : args) out.insert(out.end(), { { " " }, { {}, arg.get() } });
+#endif
+}
+
 std::string Binding::toString() const
 #ifdef DEBUG_AST_STRUCTURE
 { return " Binding( "+from.toString()+" = "+to->toString()+" )Binding "; }
@@ -95,11 +266,11 @@ std::string Binding::toString() const
 { return from.toString()+" = "+to->toString(); }
 #endif
 
-std::string Mapping::toString() const
+void Mapping::pieces(std::vector<Piece>& out) const
 #ifdef DEBUG_AST_STRUCTURE
-{ return " Mapping( "+from.toString()+" -> "+to->toString()+" )Mapping "; }
+{ out.insert(out.end(), { { " Mapping( " }, { {}, &from }, { " -> " }, { {}, to.get() }, { " )Mapping " } }); }
 #else
-{ return from.toString()+" -> "+to->toString(); }
+{ out.insert(out.end(), { { {}, &from }, { " -> " }, { {}, to.get() } }); }
 #endif
 
 }
@@ -0,0 +1,388 @@
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "headers/interpreter.hpp"
+#include "headers/arena.hpp"
+#include "headers/evaluator.hpp"
+#include "headers/machine.hpp"
+#include "headers/parser.hpp"
+
+namespace
+{
+
+using namespace LambdaCalc;
+
+/// What one run of a benchmark did, besides taking time
+struct Counts
+{
+    std::uint64_t steps = 0;
+    std::uint64_t allocations = 0;
+
+    /// What an evaluation printed
+    std::string output;
+};
+
+struct Benchmark
+{
+    std::string name;
+    std::function<Counts()> run;
+
+    /// Whether steps are counted, as they are only by the machine
+    bool counted = false;
+
+    /// What an evaluation must print, checked once before it is timed
+    std::string expected;
+};
+
+struct Result
+{
+    std::string name;
+    std::uint64_t iterations;
+    double nsPerOp;
+    double reductionsPerSec;
+    double allocationsPerOp;
+    bool counted;
+};
+
+/// An interpreter whose bindings the benchmarks evaluate against
+class Workspace : public StreamInterpreter
+{
+public:
+    using StreamInterpreter::StreamInterpreter;
+    using Interpreter::evaluate;
+};
+
+/// @return An expression for a natural number, built from the numerals up to 10 that natural.lambda binds
+std::string number(std::uint64_t n)
+{
+    if (n <= 10) return std::to_string(n);
+    return "(Nat::Add (Nat::Mult 10 " + number(n / 10) + ") " + std::to_string(n % 10) + ")";
+}
+
+AST::ExpressionPtr parse(std::string source)
+{
+    auto line = Parser<AST::Line>::parse(source);
+    auto expression = dynamic_pointer_cast<AST::Expression>(std::move(line));
+    if (!expression) throw std::runtime_error("Cannot parse benchmark: " + source);
+    return AST::ExpressionPtr(std::move(expression));
+}
+
+/// A benchmark evaluating an expression with an engine, in an arena of its own as each line is.
+/// The engines lower the expression into scratch nodes of the program, which are dropped after
+/// each run, so every run evaluates against the same program.
+Benchmark evaluation(Workspace& workspace, std::string name, const std::string& source, const std::string& expected, Interpreter::Engine engine)
+{
+    auto expr = parse(source);
+    auto printed = "\"" + expected + "\"";
+
+    if (engine == Interpreter::Engine::Machine)
+        return { name, [&workspace, expr]()
+        {
+            Arena arena;
+            Arena::Scope scope(&arena);
+
+            Machine::Evaluator evaluator(workspace.program);
+            auto output = evaluator.evaluate(*expr)->toString();
+            return Counts { evaluator.steps(), arena.allocations(), std::move(output) };
+        }, true, printed };
+
+    return { name, [&workspace, expr, engine]()
+    {
+        Arena arena;
+        Arena::Scope scope(&arena);
+
+        // The substitution engine memoizes the bindings it simplifies, which a fresh run would not have
+        workspace.bindings = workspace.bindings.snapshot();
+        workspace.engine = engine;
+        auto output = workspace.evaluate(*expr)->toString();
+        return Counts { 0, arena.allocations(), std::move(output) };
+    }, false, printed };
+}
+
+/// A benchmark parsing generated source, a line at a time as a module is
+Benchmark parsing(std::string name, std::string source)
+{
+    return { name, [source]()
+    {
+        Arena arena;
+        Arena::Scope scope(&arena);
+
+        std::istringstream input(source);
+        LineReader lines(input);
+        while (!lines.end())
+        {
+            auto text = lines.read();
+            if (!Parser<AST::Line>::parse(text)) throw std::runtime_error("Cannot parse " + text);
+        }
+
+        return Counts { 0, arena.allocations() };
+    } };
+}
+
+/// @brief Run a benchmark in rounds, each for a share of the time given, and keep the time
+///        of the fastest, which is the least disturbed by whatever else the machine is doing
+Result measure(const Benchmark& benchmark, double minSeconds, int rounds = 5)
+{
+    using Clock = std::chrono::steady_clock;
+
+    Result result { benchmark.name, 0, 0, 0, 0, benchmark.counted };
+    std::uint64_t allocations = 0;
+
+    if (!benchmark.expected.empty())
+    {
+        auto output = benchmark.run().output;
+        if (output != benchmark.expected)
+            throw std::runtime_error("Expected " + benchmark.expected + " but got " + output);
+    }
+
+    for (int round = 0; round < rounds; round++)
+    {
+        Counts total;
+        std::uint64_t iterations = 0;
+        auto start = Clock::now();
+        std::chrono::duration<double> elapsed {};
+
+        // At least one run, then as many as fit in the round
+        do
+        {
+            auto counts = benchmark.run();
+            total.steps += counts.steps;
+            total.allocations += counts.allocations;
+            iterations++;
+            elapsed = Clock::now() - start;
+        } while (elapsed.count() < minSeconds / rounds);
+
+        double nsPerOp = elapsed.count() * 1e9 / iterations;
+        if (round == 0 || nsPerOp < result.nsPerOp)
+        {
+            result.nsPerOp = nsPerOp;
+            result.reductionsPerSec = total.steps / elapsed.count();
+        }
+
+        result.iterations += iterations;
+        allocations += total.allocations;
+    }
+
+    result.allocationsPerOp = double(allocations) / result.iterations;
+    return result;
+}
+
+void writeJson(std::ostream& out, const std::vector<Result>& results)
+{
+    out << "{\n  \"benchmarks\": [\n";
+
+    for (std::size_t i = 0; i < results.size(); i++)
+    {
+        const auto& result = results[i];
+        char line[512];
+
+        // One benchmark per line, which is what readBaseline relies on
+        std::snprintf(line, sizeof(line),
+            "    {\"name\": \"%s\", \"iterations\": %llu, \"ns_per_op\": %.1f, "
+            "\"reductions_per_sec\": %s, \"allocations_per_op\": %.1f}%s\n",
+            result.name.c_str(),
+            static_cast<unsigned long long>(result.iterations),
+            result.nsPerOp,
+            result.counted ? std::to_string(std::uint64_t(result.reductionsPerSec)).c_str() : "null",
+            result.allocationsPerOp,
+            i + 1 < results.size() ? "," : ""
+        );
+        out << line;
+    }
+
+    out << "  ]\n}\n";
+}
+
+/// @return The ns/op of each benchmark in a file written by writeJson
+std::map<std::string, double> readBaseline(std::istream& in)
+{
+    std::map<std::string, double> baseline;
+    const std::string nameKey = "\"name\": \"", timeKey = "\"ns_per_op\": ";
+
+    for (std::string line; std::getline(in, line);)
+    {
+        auto name = line.find(nameKey);
+        auto time = line.find(timeKey);
+        if (name == std::string::npos || time == std::string::npos) continue;
+
+        name += nameKey.size();
+        baseline[line.substr(name, line.find('"', name) - name)] = std::stod(line.substr(time + timeKey.size()));
+    }
+
+    return baseline;
+}
+
+}
+
+int main(const int argc, const char** const argv)
+{
+    using namespace LambdaCalc;
+
+    // Parse command line arguments
+
+    std::string output;
+    std::string baselinePath;
+    std::string filter;
+    double minSeconds = 0.5;
+    double threshold = 10;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string s(argv[i]);
+        if ((s == "-o" || s == "--output") && i + 1 < argc) output = argv[++i];
+        else if (s == "--baseline" && i + 1 < argc) baselinePath = argv[++i];
+        else if (s == "--filter" && i + 1 < argc) filter = argv[++i];
+        else if (s == "--time" && i + 1 < argc) minSeconds = std::stod(argv[++i]);
+        else if (s == "--threshold" && i + 1 < argc) threshold = std::stod(argv[++i]);
+        else
+        {
+            std::cerr << "Usage: bench [-o results.json] [--baseline baseline.json] [--threshold percent] "
+                         "[--time seconds] [--filter name]" << std::endl;
+            return 1;
+        }
+    }
+
+    // The modules are embedded, so the benchmarks run from any directory
+    std::istringstream includes("#include \"stdlib\"\n#include \"main\"\n");
+    Workspace workspace(includes);
+    workspace.run();
+
+    std::vector<Benchmark> benchmarks;
+
+    // Parsing the kinds of source that bench-parse generates, at a tenth of the size:
+    // long lines, and one long `\`-continued line
+    {
+        std::string lines;
+        for (int i = 0; i < 20; i++)
+        {
+            lines += "Bench" + std::to_string(i) + " = x -> y -> x";
+            for (int j = 0; j < 500; j++) lines += " (y x)";
+            lines += " where y = z -> z, z = x\n";
+        }
+        benchmarks.push_back(parsing("parse/lines", lines));
+
+        std::string continued = "Bench = x -> x";
+        for (int j = 0; j < 2000; j++) continued += " \\\n    x";
+        benchmarks.push_back(parsing("parse/continued", continued + "\n"));
+    }
+
+    // Running the modules once they are loaded, with one loader shared between runs,
+    // and loading them as well, which starts the loader's threads and parses each module
+    auto loader = std::make_shared<ModuleLoader>();
+    benchmarks.push_back({ "include/stdlib", [loader]()
+    {
+        std::istringstream source("#include \"stdlib\"\n");
+        StreamInterpreter interpreter(source);
+        interpreter.loader = loader;
+        interpreter.run();
+        return Counts {};
+    } });
+
+    benchmarks.push_back({ "include/stdlib/load", []()
+    {
+        std::istringstream source("#include \"stdlib\"\n");
+        StreamInterpreter interpreter(source);
+        interpreter.run();
+        return Counts {};
+    } });
+
+    const auto machine = Interpreter::Engine::Machine;
+
+    // Nat::PrettyPrint prints some numbers, such as 9 and 900, as an unreduced lambda,
+    // so the sizes are chosen to print strings
+    for (std::uint64_t n : { 10, 100, 1000 })
+    {
+        auto size = std::to_string(n);
+        benchmarks.push_back(evaluation(workspace, "nat/add/" + size, "Nat::PrettyPrint (Nat::Add " + number(n) + " " + number(n) + ")", std::to_string(n + n), machine));
+        benchmarks.push_back(evaluation(workspace, "nat/div/" + size, "Nat::PrettyPrint (Nat::Div " + number(n) + " 7)", std::to_string(n / 7), machine));
+        benchmarks.push_back(evaluation(workspace, "nat/prettyprint/" + size, "Nat::PrettyPrint " + number(n), size, machine));
+    }
+
+    for (std::uint64_t n : { 4, 10, 25 })
+        benchmarks.push_back(evaluation(workspace, "nat/mult/" + std::to_string(n), "Nat::PrettyPrint (Nat::Mult " + number(n) + " " + number(n) + ")", std::to_string(n * n), machine));
+
+    for (std::uint64_t n : { 100, 1000 })
+    {
+        auto size = std::to_string(n);
+        auto list = "(List::Take " + number(n) + " Nat::All)";
+        benchmarks.push_back(evaluation(workspace, "list/map/" + size, "Nat::PrettyPrint (List::Count (List::Map Nat::Incr " + list + "))", size, machine));
+        benchmarks.push_back(evaluation(workspace, "list/foldl/" + size, "Nat::PrettyPrint (List::Foldl (count -> _ -> Nat::Incr count) 0 " + list + ")", size, machine));
+        benchmarks.push_back(evaluation(workspace, "list/take/" + size, "Nat::PrettyPrint (List::Count " + list + ")", size, machine));
+    }
+
+    const std::string fibonacci = "[0, 1, 1, 2, 3, 5, 8, 13]";
+    benchmarks.push_back(evaluation(workspace, "main/substitution", "Main", fibonacci, Interpreter::Engine::Substitution));
+    benchmarks.push_back(evaluation(workspace, "main/graph", "Main", fibonacci, Interpreter::Engine::Graph));
+    benchmarks.push_back(evaluation(workspace, "main/machine", "Main", fibonacci, machine));
+    benchmarks.push_back(evaluation(workspace, "main/bytecode", "Main", fibonacci, Interpreter::Engine::Bytecode));
+
+    // Run them
+
+    std::vector<Result> results;
+    for (const auto& benchmark : benchmarks)
+    {
+        if (benchmark.name.find(filter) == std::string::npos) continue;
+
+        try
+        {
+            results.push_back(measure(benchmark, minSeconds));
+        } catch (const std::exception& e)
+        {
+            std::cerr << benchmark.name << ": " << e.what() << std::endl;
+            return 1;
+        }
+
+        const auto& result = results.back();
+        char line[256];
+        std::snprintf(line, sizeof(line), "%-24s %14.0f ns/op %14.0f reductions/s %12.1f allocations/op",
+            result.name.c_str(), result.nsPerOp, result.reductionsPerSec, result.allocationsPerOp);
+        std::cerr << line << std::endl;
+    }
+
+    if (output.empty()) writeJson(std::cout, results);
+    else
+    {
+        std::ofstream file(output);
+        writeJson(file, results);
+    }
+
+    if (baselinePath.empty()) return 0;
+
+    // Compare against the baseline, failing if anything is slower by more than the threshold
+
+    std::ifstream file(baselinePath);
+    if (file.fail())
+    {
+        std::cerr << "Failed to open baseline: \"" << baselinePath << "\"" << std::endl;
+        return 1;
+    }
+
+    auto baseline = readBaseline(file);
+    bool regressed = false;
+
+    for (const auto& result : results)
+    {
+        auto found = baseline.find(result.name);
+        if (found == baseline.end()) continue;
+
+        double change = (result.nsPerOp / found->second - 1) * 100;
+        bool regression = change > threshold;
+        regressed |= regression;
+
+        char line[256];
+        std::snprintf(line, sizeof(line), "%-24s %+7.1f%%%s", result.name.c_str(), change, regression ? "  REGRESSION" : "");
+        std::cerr << line << std::endl;
+    }
+
+    return regressed ? 1 : 0;
+}
@@ -0,0 +1,73 @@
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "headers/builtin.hpp"
+
+namespace LambdaCalc::Builtins
+{
+
+namespace
+{
+
+const std::string& string(const Datum& datum) { return std::get<std::string>(datum); }
+std::uint64_t number(const Datum& datum) { return std::get<std::uint64_t>(datum); }
+
+class Registry
+{
+public:
+    std::vector<Primitive> primitives;
+
+    /// @brief The id of the primitive with each symbol, or none
+    std::vector<std::uint32_t> ids;
+
+    static constexpr std::uint32_t none = UINT32_MAX;
+
+    Registry()
+    {
+        using enum Type;
+
+        add("String::Equal", { String, String }, Bool, [](const std::vector<Datum>& args) -> Datum
+        { return string(args[0]) == string(args[1]); });
+
+        add("String::Length", { String }, Number, [](const std::vector<Datum>& args) -> Datum
+        { return std::uint64_t(string(args[0]).size()); });
+
+        add("Nat::Equal", { Number, Number }, Bool, [](const std::vector<Datum>& args) -> Datum
+        { return number(args[0]) == number(args[1]); });
+
+        add("Nat::ToString", { Number }, String, [](const std::vector<Datum>& args) -> Datum
+        { return std::to_string(number(args[0])); });
+    }
+
+private:
+    void add(const char* name, std::vector<Type> parameters, Type result, Datum (*apply)(const std::vector<Datum>&))
+    {
+        Symbol symbol(name);
+        std::uint32_t id = primitives.size();
+        primitives.push_back({ id, symbol, std::move(parameters), result, apply });
+
+        if (symbol.id >= ids.size()) ids.resize(symbol.id + 1, none);
+        ids[symbol.id] = id;
+    }
+};
+
+const Registry& registry()
+{
+    static const Registry registry;
+    return registry;
+}
+
+}
+
+const Primitive* find(Symbol name)
+{
+    const auto& ids = registry().ids;
+    if (name.id >= ids.size() || ids[name.id] == Registry::none) return nullptr;
+    return &registry().primitives[ids[name.id]];
+}
+
+const Primitive& get(std::uint32_t id)
+{ return registry().primitives[id]; }
+
+}
@@ -0,0 +1,237 @@
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "headers/bytecode.hpp"
+#include "headers/arena.hpp"
+#include "headers/evaluator.hpp"
+#include "headers/machine.hpp"
+#include "headers/ir.hpp"
+#include "headers/ast.hpp"
+
+namespace LambdaCalc::Bytecode
+{
+
+using IR::Index;
+using Machine::Environment;
+using Machine::Frame;
+using Machine::Thunk;
+using Machine::Value;
+
+/// An instruction that suspends a term, where suspend is ArgThunk or LetThunk.
+/// Each is followed by its Var, Closure and String forms, which need no new thunk.
+static Instruction suspension(const IR::Program& program, Op suspend, Index term)
+{
+    const auto& node = program.nodes[term];
+    auto form = [&](int offset) { return Op(std::uint8_t(suspend) + offset); };
+
+    switch (node.kind)
+    {
+    case IR::Node::Kind::Variable:
+        return { form(1), node.value };
+
+    case IR::Node::Kind::Lambda:
+        return { form(2), term };
+
+    case IR::Node::Kind::String:
+        return { form(3), node.value };
+
+    default:
+        return { suspend, term };
+    }
+}
+
+Code::Scratch::Scratch(Code& code, const IR::Program& program) :
+    code(code),
+    instructions(code.instructions.size())
+{
+    code.scratchNodes = program.nodes.size();
+    code.scratchTerms.clear();
+    code.kept = false;
+}
+
+Code::Scratch::~Scratch()
+{
+    for (auto term : code.scratchTerms) code.blocks[term] = IR::none;
+
+    if (!code.kept)
+    {
+        code.instructions.resize(instructions);
+        code.threaded = std::min(code.threaded, instructions);
+    }
+
+    code.scratchNodes = IR::none;
+    code.scratchTerms.clear();
+}
+
+std::uint32_t Code::compile(const IR::Program& program, Index term)
+{
+    if (term >= blocks.size()) blocks.resize(program.nodes.size(), IR::none);
+
+    if (term >= scratchNodes) scratchTerms.push_back(term);
+    else kept |= scratchNodes != IR::none;
+
+    std::uint32_t start = instructions.size();
+
+    for (Index index = term;;)
+    {
+        const auto& node = program.nodes[index];
+
+        switch (node.kind)
+        {
+        case IR::Node::Kind::Application:
+            instructions.push_back(suspension(program, Op::ArgThunk, node.right));
+            index = node.left;
+            continue;
+
+        case IR::Node::Kind::Let:
+            instructions.push_back(suspension(program, Op::LetThunk, node.left));
+            index = node.right;
+            continue;
+
+        case IR::Node::Kind::StrictLet:
+            instructions.push_back({ Op::StrictLet, index });
+            break;
+
+        case IR::Node::Kind::Variable:
+            instructions.push_back({ Op::Var, node.value });
+            break;
+
+        case IR::Node::Kind::Global:
+            instructions.push_back({ Op::Global, node.value });
+            break;
+
+        case IR::Node::Kind::Lambda:
+            instructions.push_back({ Op::Closure, index });
+            break;
+
+        case IR::Node::Kind::String:
+            instructions.push_back({ Op::String, node.value });
+            break;
+
+        case IR::Node::Kind::Builtin:
+            instructions.push_back({ Op::Builtin, index });
+            break;
+        }
+
+        break;
+    }
+
+    return blocks[term] = start;
+}
+
+AST::ExpressionPtr VM::evaluate(const AST::Expression& expr)
+{
+    IR::Program::Scratch scratch(program);
+    Code::Scratch compiled(code, program);
+
+    program.recognise();
+    Index root = program.lower(expr);
+    globals.resize(program.globals.size());
+
+    return Machine::readBack(program, run(root));
+}
+
+/// Dispatch is direct-threaded with the labels-as-values extension of clang and gcc:
+/// each instruction holds the address of its handler, which jumps straight to the next.
+Machine::ValuePtr VM::run(Index root)
+{
+    // In the order of Op
+    static const void* const handlers[opCount] = {
+        &&arg_thunk, &&arg_var, &&arg_closure, &&arg_string,
+        &&let_thunk, &&let_var, &&let_closure, &&let_string,
+        &&strict_let, &&var, &&global, &&builtin, &&closure, &&string
+    };
+
+    auto& instructions = code.instructions;
+    std::uint32_t pc;
+
+    term = root;
+    env = nullptr;
+    value = nullptr;
+    stack.clear();
+
+    goto run;
+
+dispatch:
+    goto *instructions[pc].handler;
+
+arg_thunk:
+    stack.push_back({ Frame::Kind::Argument, make_arena_shared<Thunk>(instructions[pc].operand, env) });
+    pc++;
+    goto dispatch;
+
+arg_var:
+    stack.push_back({ Frame::Kind::Argument, Machine::lookup(env, instructions[pc].operand) });
+    pc++;
+    goto dispatch;
+
+arg_closure:
+    stack.push_back({ Frame::Kind::Argument, make_arena_shared<Thunk>(make_arena_shared<Value>(instructions[pc].operand, env)) });
+    pc++;
+    goto dispatch;
+
+arg_string:
+    stack.push_back({ Frame::Kind::Argument, make_arena_shared<Thunk>(make_arena_shared<Value>(program.strings[instructions[pc].operand])) });
+    pc++;
+    goto dispatch;
+
+let_thunk:
+    env = make_arena_shared<Environment>(make_arena_shared<Thunk>(instructions[pc].operand, env), env);
+    pc++;
+    goto dispatch;
+
+let_var:
+    env = make_arena_shared<Environment>(Machine::lookup(env, instructions[pc].operand), env);
+    pc++;
+    goto dispatch;
+
+let_closure:
+    env = make_arena_shared<Environment>(make_arena_shared<Thunk>(make_arena_shared<Value>(instructions[pc].operand, env)), env);
+    pc++;
+    goto dispatch;
+
+let_string:
+    env = make_arena_shared<Environment>(make_arena_shared<Thunk>(make_arena_shared<Value>(program.strings[instructions[pc].operand])), env);
+    pc++;
+    goto dispatch;
+
+strict_let:
+{
+    const auto& node = program.nodes[instructions[pc].operand];
+    sequence(make_arena_shared<Thunk>(node.left, env), node.right);
+    goto next;
+}
+
+var:
+    enter(Machine::lookup(env, instructions[pc].operand));
+    goto next;
+
+global:
+    enter(global(instructions[pc].operand));
+    goto next;
+
+builtin:
+    primitive(instructions[pc].operand);
+    goto next;
+
+closure:
+    value = make_arena_shared<Value>(instructions[pc].operand, env);
+    goto next;
+
+string:
+    value = make_arena_shared<Value>(program.strings[instructions[pc].operand]);
+    goto next;
+
+// Pass the value to the stack until a step leaves a term to run, then run its block
+next:
+    while (value) if (!pass()) return std::move(value);
+
+run:
+    pc = code.block(program, term);
+    code.thread(handlers);
+    goto dispatch;
+}
+
+}
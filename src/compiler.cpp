@@ -0,0 +1,304 @@
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "headers/compiler.hpp"
+#include "headers/interpreter.hpp"
+#include "headers/module.hpp"
+#include "headers/parser.hpp"
+#include "headers/ir.hpp"
+#include "headers/ast.hpp"
+
+namespace LambdaCalc
+{
+
+using IR::Index;
+using IR::Node;
+
+void Compiler::include(const std::string& name)
+{
+    std::ifstream file(name + ".lambda");
+    if (file.fail())
+        throw compile_error("Failed to open file: \""+name+".lambda\"");
+
+    LineReader reader(file);
+    while (!reader.end())
+    {
+        auto source = reader.read();
+        std::unique_ptr<AST::Line> line = Parser<AST::Line>::parse(source);
+
+        if (!line || source.length() > 0)
+            throw compile_error("Unable to parse: \"" + source + "\" in " + name + ".lambda");
+
+        if (auto binding = dynamic_cast<AST::Binding*>(line.get()))
+        {
+            program.define(binding->from.name, *binding->to);
+
+            auto slot = program.slot(binding->from.name);
+            steps.push_back({ slot, program.globals[slot].root });
+        }
+
+        if (auto expression = dynamic_cast<AST::Expression*>(line.get()))
+            evaluate(*expression);
+
+        // The runtime has no primitives, as they are only linked into the interpreter
+        if (auto builtin = dynamic_cast<AST::BuiltinDecl*>(line.get()))
+            throw compile_error("Builtins cannot be compiled ahead of time: `" + builtin->toString() + "` in " + name + ".lambda");
+
+        if (auto include = dynamic_cast<AST::Include*>(line.get()))
+        if (!includes.contains(include->name))
+        {
+            includes.insert(include->name);
+            this->include(include->name);
+        }
+    }
+}
+
+void Compiler::evaluate(const AST::Expression& expr)
+{ steps.push_back({ IR::none, program.lower(expr) }); }
+
+/// A C++ string literal of a string
+static std::string literal(const std::string& str)
+{
+    std::ostringstream out;
+    out << '"';
+    for (unsigned char c : str)
+    {
+        if (c == '"' || c == '\\') out << '\\' << c;
+        else if (c >= ' ' && c < 0x7f) out << c;
+        else out << "\\" << std::oct << int(c >> 6) << int((c >> 3) & 7) << int(c & 7) << std::dec;
+    }
+    out << '"';
+    return out.str();
+}
+
+static const char* kindName(Node::Kind kind)
+{
+    switch (kind)
+    {
+    case Node::Kind::Variable: return "Variable";
+    case Node::Kind::Global: return "Global";
+    case Node::Kind::Lambda: return "Lambda";
+    case Node::Kind::Application: return "Application";
+    case Node::Kind::String: return "String";
+    case Node::Kind::Let: return "Let";
+    case Node::Kind::StrictLet: return "StrictLet";
+    case Node::Kind::Builtin: return "Builtin";
+    }
+
+    throw std::logic_error("Unknown IR node kind");
+}
+
+void Compiler::emit(std::ostream& out) const
+{
+    const auto& nodes = program.nodes;
+
+    // Every term that can be run: roots, thunks, lambda bodies and the bodies of strict lets
+    std::vector<bool> runnable(nodes.size());
+    std::vector<Index> pending;
+
+    auto run = [&](Index term)
+    {
+        if (runnable[term]) return;
+        runnable[term] = true;
+        pending.push_back(term);
+    };
+
+    /// A suspension of a term, needing a block of code if it is not a variable, lambda or string
+    auto suspension = [&](Index term) -> std::string
+    {
+        const auto& node = nodes[term];
+        switch (node.kind)
+        {
+        case Node::Kind::Variable:
+            return "e.var(" + std::to_string(node.value) + ")";
+
+        case Node::Kind::Lambda:
+            run(node.left);
+            return "e.closure(" + std::to_string(term) + ")";
+
+        case Node::Kind::String:
+            return "e.string(" + std::to_string(node.value) + ")";
+
+        default:
+            run(term);
+            return "e.thunk(" + std::to_string(term) + ")";
+        }
+    };
+
+    for (const auto& step : steps) run(step.root);
+
+    std::ostringstream blocks;
+    while (!pending.empty())
+    {
+        Index term = pending.back();
+        pending.pop_back();
+
+        blocks << "static void block" << term << "(Runtime::Evaluator& e)\n{\n";
+
+        for (Index index = term;;)
+        {
+            const auto& node = nodes[index];
+
+            switch (node.kind)
+            {
+            case Node::Kind::Application:
+                blocks << "    e.arg(" << suspension(node.right) << ");\n";
+                index = node.left;
+                continue;
+
+            case Node::Kind::Let:
+                blocks << "    e.let(" << suspension(node.left) << ");\n";
+                index = node.right;
+                continue;
+
+            case Node::Kind::StrictLet:
+                run(node.left);
+                run(node.right);
+                blocks << "    e.strictLet(" << node.left << ", " << node.right << ");\n";
+                break;
+
+            case Node::Kind::Variable:
+                blocks << "    e.enter(e.var(" << node.value << "));\n";
+                break;
+
+            case Node::Kind::Global:
+                blocks << "    e.enterGlobal(" << node.value << ");\n";
+                break;
+
+            case Node::Kind::Lambda:
+                run(node.left);
+                blocks << "    e.returnClosure(" << index << ");\n";
+                break;
+
+            case Node::Kind::String:
+                blocks << "    e.returnString(" << node.value << ");\n";
+                break;
+
+            case Node::Kind::Builtin:
+                throw compile_error("Builtins cannot be compiled ahead of time");
+            }
+
+            break;
+        }
+
+        blocks << "}\n\n";
+    }
+
+    // Bound names are numbered by their position in names, as symbols differ between processes
+    std::vector<Symbol> names;
+    std::unordered_map<Symbol::Id, std::uint32_t> nameIndices;
+    auto name = [&](std::uint32_t id)
+    {
+        auto [it, added] = nameIndices.try_emplace(id, names.size());
+        if (added) names.push_back(Symbol::fromId(id));
+        return it->second;
+    };
+
+    out << "// Generated by lambdac. Do not edit.\n\n";
+    out << "#include \"runtime.hpp\"\n\n";
+    out << "using namespace LambdaCalc;\n";
+    out << "using Kind = IR::Node::Kind;\n\n";
+
+    out << blocks.str();
+
+    out << "static const IR::Node nodes[] = {\n";
+    for (const auto& node : nodes)
+    {
+        bool named = node.kind == Node::Kind::Lambda
+                  || node.kind == Node::Kind::Let
+                  || node.kind == Node::Kind::StrictLet;
+
+        out << "    { Kind::" << kindName(node.kind) << ", "
+            << (named ? name(node.value) : node.value) << ", "
+            << node.left << ", " << node.right << " },\n";
+    }
+    out << "};\n\n";
+
+    out << "static const char* const names[] = {\n";
+    for (const auto& symbol : names) out << "    " << literal(symbol.str()) << ",\n";
+    out << "    nullptr\n};\n\n";
+
+    out << "static const char* const strings[] = {\n";
+    for (const auto& str : program.strings) out << "    " << literal(str) << ",\n";
+    out << "    nullptr\n};\n\n";
+
+    out << "static const char* const globals[] = {\n";
+    for (const auto& global : program.globals) out << "    " << literal(global.name.str()) << ",\n";
+    out << "    nullptr\n};\n\n";
+
+    out << "static const Runtime::Step steps[] = {\n";
+    for (const auto& step : steps)
+        out << "    { " << (step.slot == IR::none ? "IR::none" : std::to_string(step.slot)) << ", " << step.root << " },\n";
+    out << "    { IR::none, IR::none }\n};\n\n";
+
+    out << "static const Runtime::Block blocks[] = {\n";
+    for (Index index = 0; index < nodes.size(); index++)
+        out << "    " << (runnable[index] ? "block" + std::to_string(index) : "nullptr") << ",\n";
+    out << "    nullptr\n};\n\n";
+
+    out << "int main()\n{\n";
+    out << "    return Runtime::run({\n";
+    out << "        nodes, " << nodes.size() << ",\n";
+    out << "        names, " << names.size() << ",\n";
+    out << "        strings, " << program.strings.size() << ",\n";
+    out << "        globals, " << program.globals.size() << ",\n";
+    out << "        steps, " << steps.size() << ",\n";
+    out << "        blocks\n";
+    out << "    });\n";
+    out << "}\n";
+}
+
+void embed(std::ostream& out, const std::vector<std::string>& modules)
+{
+    out << "// Generated by lambdac --embed\n";
+    out << "#include \"module.hpp\"\n\n";
+    out << "using namespace LambdaCalc;\n\n";
+
+    for (std::size_t i = 0; i < modules.size(); i++)
+    {
+        const auto& name = modules[i];
+
+        std::ifstream file(name + ".lambda");
+        if (file.fail())
+            throw compile_error("Failed to open file: \""+name+".lambda\"");
+
+        std::string source((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        std::istringstream input(source);
+
+        // Parse the module as the interpreter would, recording its lines
+        Module::Writer writer;
+        LineReader reader(input);
+        while (!reader.end())
+        {
+            auto line = reader.read();
+            std::unique_ptr<AST::Line> parsed = Parser<AST::Line>::parse(line);
+
+            if (!parsed || line.length() > 0)
+                throw compile_error("Unable to parse: \"" + line + "\" in " + name + ".lambda");
+
+            writer.write(*parsed);
+        }
+
+        auto cache = writer.serialize(Module::hash(source));
+
+        out << "static const unsigned char module" << i << "[] = {";
+        for (std::size_t j = 0; j < cache.size(); j++)
+            out << (j % 16 ? " " : "\n    ") << unsigned(static_cast<unsigned char>(cache[j])) << ",";
+        out << "\n};\n\n";
+    }
+
+    out << "static const Module::Embedded modules[] = {\n";
+    for (std::size_t i = 0; i < modules.size(); i++)
+        out << "    { " << literal(modules[i]) << ", module" << i << ", sizeof(module" << i << ") },\n";
+    out << "};\n\n";
+
+    out << "static Module::Library library(modules, " << modules.size() << ");\n";
+}
+
+}
@@ -1,8 +1,12 @@
+#include <algorithm>
 #include <concepts>
+#include <optional>
 #include <sstream>
 #include <unordered_map>
 
 #include "headers/evaluator.hpp"
+#include "headers/arena.hpp"
+#include "headers/parallel.hpp"
 #include "headers/util.hpp"
 #include "headers/ast.hpp"
 
@@ -11,112 +15,192 @@ namespace LambdaCalc
 
 using namespace AST;
 
-std::unique_ptr<AST::Expression> AST::Expression::simplify(
+ExpressionPtr AST::Expression::simplify(
     const BindingTable& bindings
-) const { return getExpressionCopy(); }
+) const { return shared_from_this(); }
 
-std::unique_ptr<AST::Expression> AST::LetExpr::simplify(
+ExpressionPtr AST::LetExpr::simplify(
     const BindingTable& bindings
 ) const {
     return expr
-        ->getExpressionCopy()
-        ->substitute(binding->from.name, *binding->to->simplify(bindings))
+        ->substitute(binding->from.name, binding->to->simplify(bindings))
         ->simplify(bindings);
 }
 
-std::unique_ptr<Expression> AST::LetExpr::substitute(
-    std::string name,
-    const Expression& expr
+ExpressionPtr AST::LetExpr::substitute(
+    Symbol name,
+    const ExpressionPtr& expr
 ) const {
-    if (name == binding->from.name) return getExpressionCopy();
+    if (!mayContain(name) || name == binding->from.name) return shared_from_this();
 
     auto new_binding_expr = binding->to->substitute(name, expr);
     auto new_expr = this->expr->substitute(name, expr);
 
-    return std::make_unique<AST::LetExpr>(
-        std::make_unique<AST::Binding>(binding->from, std::move(new_binding_expr)),
+    if (new_binding_expr == binding->to && new_expr == this->expr)
+        return shared_from_this();
+
+    return make_arena_shared<AST::LetExpr>(
+        make_arena_shared<AST::Binding>(binding->from, std::move(new_binding_expr)),
         std::move(new_expr)
     );
 }
 
-std::unique_ptr<AST::Expression> AST::WhereExpr::simplify(
+ExpressionPtr AST::WhereExpr::simplify(
     const BindingTable& bindings
 ) const {
     return expr
-        ->getExpressionCopy()
-        ->substitute(binding->from.name, *binding->to->getExpressionCopy())
+        ->substitute(binding->from.name, binding->to)
         ->simplify(bindings);
 }
 
-std::unique_ptr<Expression> AST::WhereExpr::substitute(
-    std::string name,
-    const Expression& expr
+ExpressionPtr AST::WhereExpr::substitute(
+    Symbol name,
+    const ExpressionPtr& expr
 ) const {
-    if (name == binding->from.name) return getExpressionCopy();
+    if (!mayContain(name) || name == binding->from.name) return shared_from_this();
 
     auto new_binding_expr = binding->to->substitute(name, expr);
     auto new_expr = this->expr->substitute(name, expr);
 
-    return std::make_unique<AST::WhereExpr>(
+    if (new_binding_expr == binding->to && new_expr == this->expr)
+        return shared_from_this();
+
+    return make_arena_shared<AST::WhereExpr>(
         std::move(new_expr),
-        std::make_unique<AST::Binding>(binding->from, std::move(new_binding_expr))
+        make_arena_shared<AST::Binding>(binding->from, std::move(new_binding_expr))
     );
 }
 
-std::unique_ptr<Expression> AST::Mapping::substitute(
-    std::string name,
-    const Expression& expr
+ExpressionPtr AST::Mapping::substitute(
+    Symbol name,
+    const ExpressionPtr& expr
 ) const {
-    if (name == from.name) return getExpressionCopy();
-    else return std::make_unique<AST::Mapping>(
-        from,
-        to->substitute(name, expr)
-    );
+    if (!mayContain(name) || name == from.name) return shared_from_this();
+
+    auto new_to = to->substitute(name, expr);
+    if (new_to == to) return shared_from_this();
+
+    return make_arena_shared<AST::Mapping>(from, std::move(new_to));
 }
 
-std::unique_ptr<AST::Expression> AST::Name::simplify(
+ExpressionPtr AST::Name::simplify(
     const BindingTable& bindings
 ) const {
-    try {
-        return bindings.at(name)->simplify(bindings);
-    } catch (std::out_of_range e)
-    { throw evaluation_error("Cannot evaluate `"+name+"`, it is not defined."); }
+    if (const auto& memo = bindings.memoized(name)) return memo;
+
+    const auto& expr = bindings.at(name);
+    if (!expr) throw evaluation_error("Cannot evaluate `"+name.str()+"`, it is not defined.");
+
+    auto simplified = expr->simplify(bindings);
+
+    // Bindings only refer to other bindings, so their simplified form is the same
+    // wherever they are used. It outlives this evaluation, so must not be in the arena.
+    if (simplified == expr) bindings.memoize(name, simplified);
+    else
+    {
+        Arena::Scope heap(nullptr);
+        bindings.memoize(name, simplified->deepCopy());
+    }
+
+    return simplified;
 }
 
-std::unique_ptr<Expression> AST::Name::substitute(
-    std::string name,
-    const Expression& expr
+ExpressionPtr AST::Name::substitute(
+    Symbol name,
+    const ExpressionPtr& expr
 ) const {
-    if (this->name == name) return expr.getExpressionCopy();
-    else return getExpressionCopy();
+    if (this->name == name) return expr;
+    else return shared_from_this();
 }
 
-std::unique_ptr<AST::Expression> AST::BracketExpr::simplify(
+ExpressionPtr AST::BracketExpr::simplify(
     const BindingTable& bindings
 ) const { return expr->simplify(bindings); }
 
-std::unique_ptr<Expression> AST::BracketExpr::substitute(
-    std::string name,
-    const Expression& expr
+ExpressionPtr AST::BracketExpr::substitute(
+    Symbol name,
+    const ExpressionPtr& expr
 ) const {
     return this->expr->substitute(name, expr);
 }
 
-std::unique_ptr<AST::Expression> AST::ApplicationExpr::simplify(
+/// Terms smaller than this are simplified sooner than a worker could be handed them
+static constexpr std::size_t minimumForkSize = 6;
+
+/// Whether simplifying an expression on another thread may be worth it:
+/// it is not already a value, and is made of at least a few nodes
+static bool worthForking(const Expression& expr)
+{
+    const Expression* root = &expr;
+    while (auto bracket = dynamic_cast<const BracketExpr*>(root)) root = bracket->expr.get();
+
+    if (dynamic_cast<const Name*>(root)
+     || dynamic_cast<const String*>(root)
+     || dynamic_cast<const Mapping*>(root))
+        return false;
+
+    std::size_t size = 0;
+    std::vector<Expression::Piece> pieces;
+    std::vector<const Expression*> pending { root };
+
+    while (!pending.empty() && size < minimumForkSize)
+    {
+        auto node = pending.back();
+        pending.pop_back();
+        size++;
+
+        pieces.clear();
+        node->pieces(pieces);
+        for (const auto& piece : pieces)
+            if (piece.expr) pending.push_back(piece.expr);
+    }
+
+    return size >= minimumForkSize;
+}
+
+/// Whether an expression is a string applied to arguments, which either simplifies to a
+/// string or fails, so that whatever it is applied to is certain to be simplified too
+static bool concatenation(const Expression& expr)
+{
+    const Expression* root = &expr;
+    while (true)
+    {
+        if (auto bracket = dynamic_cast<const BracketExpr*>(root)) root = bracket->expr.get();
+        else if (auto application = dynamic_cast<const ApplicationExpr*>(root)) root = application->left.get();
+        else break;
+    }
+
+    return dynamic_cast<const String*>(root);
+}
+
+ExpressionPtr AST::ApplicationExpr::simplify(
     const BindingTable& bindings
 ) const {
+    // With a pool, the right side of a concatenation is simplified on it while the left side
+    // is. Nothing else is forked, as a right side that is not needed may never finish.
+    std::optional<Parallel::Fork> fork;
+    if (auto pool = Parallel::Pool::current())
+    {
+        Parallel::Pool::interruptionPoint();
+        if (concatenation(*left) && worthForking(*right) && !pool->saturated()) fork.emplace(*pool, right);
+    }
+
     auto _left = left->simplify(bindings);
 
-    if (auto mapping = dynamic_cast<Mapping*>(_left.get()))
+    if (auto mapping = dynamic_cast<const Mapping*>(_left.get()))
     {
-        return mapping->to->substitute(mapping->from.name, *right)->simplify(bindings);
+        return mapping->to->substitute(mapping->from.name, right)->simplify(bindings);
     }
-    else if (auto _left_string = dynamic_cast<String*>(_left.get()))
+    else if (auto builtin = dynamic_cast<const Builtin*>(_left.get()))
     {
-        auto _right = right->simplify(bindings);
+        return builtin->apply(right)->simplify(bindings);
+    }
+    else if (auto _left_string = dynamic_cast<const String*>(_left.get()))
+    {
+        auto _right = fork ? fork->join(bindings) : right->simplify(bindings);
 
-        if (auto _right_string = dynamic_cast<String*>(_right.get()))
-            return std::make_unique<String>(_left_string->str + _right_string->str);
+        if (auto _right_string = dynamic_cast<const String*>(_right.get()))
+            return make_arena_shared<String>(_left_string->str + _right_string->str);
         
         throw evaluation_error(
             "Left side of application expression must not be a string "
@@ -126,18 +210,110 @@ std::unique_ptr<AST::Expression> AST::ApplicationExpr::simplify(
     else return _left;
 }
 
-std::unique_ptr<Expression> AST::ApplicationExpr::substitute(
-    std::string name,
-    const Expression& expr
+/// The native form of an argument of a primitive, simplifying it as far as is needed
+static Builtins::Datum native(
+    const Builtin& builtin,
+    Builtins::Type type,
+    const ExpressionPtr& arg,
+    const BindingTable& bindings
+) {
+    if (type == Builtins::Type::String)
+    {
+        auto simplified = arg->simplify(bindings);
+        if (auto str = dynamic_cast<const String*>(simplified.get())) return str->str.flatten();
+
+        throw evaluation_error(
+            "`" + builtin.primitive->name.str() + "` expects a string, "
+            "but was given " + simplified->toString() + " in " + builtin.toString());
+    }
+
+    // A Church numeral n counts itself as the length of n (s -> s "|") ""
+    const static Symbol s("s");
+    auto tally = make_arena_shared<Mapping>(Name(s), make_arena_shared<ApplicationExpr>(
+        make_arena_shared<Name>(s), make_arena_shared<String>("|")
+    ));
+    auto counted = make_arena_shared<ApplicationExpr>(
+        make_arena_shared<ApplicationExpr>(arg, SimpleExpr::wrap(tally)),
+        make_arena_shared<String>("")
+    )->simplify(bindings);
+
+    if (auto str = dynamic_cast<const String*>(counted.get())) return std::uint64_t(str->str.size());
+
+    throw evaluation_error(
+        "`" + builtin.primitive->name.str() + "` expects a numeral, "
+        "but was given " + arg->toString() + " in " + builtin.toString());
+}
+
+/// The expression of a native result of a primitive
+static ExpressionPtr expression(Builtins::Type type, const Builtins::Datum& result)
+{
+    const static Symbol a("a"), b("b"), f("f"), x("x");
+
+    switch (type)
+    {
+    case Builtins::Type::String:
+        return make_arena_shared<String>(std::get<std::string>(result));
+
+    case Builtins::Type::Bool:
+        return make_arena_shared<Mapping>(Name(a), make_arena_shared<Mapping>(
+            Name(b), make_arena_shared<Name>(std::get<bool>(result) ? a : b)
+        ));
+
+    case Builtins::Type::Number:
+    default:
+    {
+        ExpressionPtr body = make_arena_shared<Name>(x);
+        for (auto n = std::get<std::uint64_t>(result); n > 0; n--)
+            body = make_arena_shared<ApplicationExpr>(make_arena_shared<Name>(f), SimpleExpr::wrap(std::move(body)));
+
+        return make_arena_shared<Mapping>(Name(f), make_arena_shared<Mapping>(Name(x), std::move(body)));
+    }
+    }
+}
+
+ExpressionPtr AST::Builtin::simplify(
+    const BindingTable& bindings
 ) const {
+    if (args.size() < primitive->arity()) return shared_from_this();
+
+    std::vector<Builtins::Datum> arguments;
+    for (std::size_t i = 0; i < args.size(); i++)
+        arguments.push_back(native(*this, primitive->parameters[i], args[i], bindings));
+
+    return expression(primitive->result, primitive->apply(arguments));
+}
+
+ExpressionPtr AST::Builtin::substitute(
+    Symbol name,
+    const ExpressionPtr& expr
+) const {
+    if (!mayContain(name)) return shared_from_this();
+
+    std::vector<std::shared_ptr<const SimpleExpr>> substituted;
+    bool changed = false;
+    for (const auto& arg : args)
+    {
+        substituted.push_back(SimpleExpr::wrap(arg->substitute(name, expr)));
+        changed |= substituted.back() != arg;
+    }
+
+    if (!changed) return shared_from_this();
+
+    return make_arena_shared<Builtin>(primitive, std::move(substituted));
+}
+
+ExpressionPtr AST::ApplicationExpr::substitute(
+    Symbol name,
+    const ExpressionPtr& expr
+) const {
+    if (!mayContain(name)) return shared_from_this();
+
     auto _left = left->substitute(name, expr);
     auto _right = right->substitute(name, expr);
 
-    auto simple_right = dynamic_cast<SimpleExpr*>(_right.get())
-        ? dynamic_pointer_cast<SimpleExpr>(std::move(_right))
-        : std::make_unique<BracketExpr>(std::move(_right));
+    if (_left == left && _right == right) return shared_from_this();
 
-    return std::make_unique<AST::ApplicationExpr>(std::move(_left), std::move(simple_right));
+    return make_arena_shared<AST::ApplicationExpr>(std::move(_left), SimpleExpr::wrap(std::move(_right)));
 }
 
 }
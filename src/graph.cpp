@@ -0,0 +1,290 @@
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "headers/graph.hpp"
+#include "headers/arena.hpp"
+#include "headers/evaluator.hpp"
+#include "headers/ir.hpp"
+#include "headers/ast.hpp"
+
+namespace LambdaCalc::Graph
+{
+
+using IR::Index;
+
+Environment::~Environment()
+{
+    release(std::move(node));
+    release(std::move(next));
+}
+
+Node::~Node()
+{
+    release(std::move(left));
+    release(std::move(right));
+    release(std::move(env));
+}
+
+static const NodePtr& lookup(const EnvironmentPtr& env, std::uint32_t index)
+{
+    auto frame = env.get();
+    for (; index > 0; index--) frame = frame->next.get();
+    return frame->node;
+}
+
+AST::ExpressionPtr Evaluator::evaluate(const AST::Expression& expr)
+{
+    IR::Program::Scratch scratch(program);
+    Index root = program.lower(expr);
+    globals.resize(program.globals.size());
+
+    return readBack(reduce(instantiate(root, nullptr)));
+}
+
+NodePtr Evaluator::global(IR::Slot slot)
+{
+    if (globals[slot]) return globals[slot];
+
+    const auto& global = program.globals[slot];
+    if (global.root == IR::none)
+        throw evaluation_error("Cannot evaluate `"+global.name.str()+"`, it is not defined.");
+
+    return globals[slot] = instantiate(global.root, nullptr);
+}
+
+NodePtr Evaluator::instantiate(Index index, const EnvironmentPtr& env)
+{
+    const auto& node = program.nodes[index];
+
+    switch (node.kind)
+    {
+    case IR::Node::Kind::Variable:
+        return lookup(env, node.value);
+
+    case IR::Node::Kind::Global:
+        return make_arena_shared<Node>(Node::Kind::Global, node.value);
+
+    case IR::Node::Kind::Lambda:
+        return make_arena_shared<Node>(Node::Kind::Closure, index, env);
+
+    case IR::Node::Kind::Application:
+        return make_arena_shared<Node>(
+            Node::Kind::Application,
+            instantiate(node.left, env),
+            instantiate(node.right, env)
+        );
+
+    case IR::Node::Kind::String:
+        return make_arena_shared<Node>(program.strings[node.value]);
+
+    case IR::Node::Kind::Let:
+    {
+        auto value = instantiate(node.left, env);
+        return instantiate(node.right, make_arena_shared<Environment>(value, env));
+    }
+
+    case IR::Node::Kind::StrictLet:
+    {
+        auto value = instantiate(node.left, env);
+        auto body = instantiate(node.right, make_arena_shared<Environment>(value, env));
+        return make_arena_shared<Node>(Node::Kind::Sequence, value, body);
+    }
+
+    case IR::Node::Kind::Builtin:
+        throw evaluation_error("Builtins are not supported by the graph engine, use -m or the default engine");
+    }
+
+    throw std::logic_error("Unknown IR node kind");
+}
+
+NodePtr Evaluator::reduce(NodePtr node)
+{
+    /// A node waiting on the value of one of its children, reduced on the same loop
+    struct Frame
+    {
+        enum class Kind
+        {
+            Function,   ///< node is an application, blackholed while its function is reduced
+            Argument,   ///< node applies the string function to its argument, being reduced
+            Sequence    ///< node is a sequence, whose left side is being reduced
+        } kind;
+
+        NodePtr node;
+        NodePtr function;
+
+        /// The updates and aliases of node, which resume once the child is reduced
+        std::size_t updates;
+        std::size_t aliases;
+    };
+
+    std::vector<Frame> frames;
+
+    // Nodes that reduce to the same value as node, to be short-circuited once it is known.
+    // Those of the nodes in frames come first, up to the size saved in the frame above them.
+    std::vector<NodePtr> updates;
+
+    // Globals followed in a row, which can only exceed the number of globals in a cycle
+    std::size_t aliases = 0;
+
+    auto enter = [&](Frame::Kind kind, NodePtr parent, NodePtr function, NodePtr child)
+    {
+        frames.push_back({ kind, std::move(parent), std::move(function), updates.size(), aliases });
+        aliases = 0;
+        node = std::move(child);
+    };
+
+    while (true) switch (node->kind)
+    {
+    case Node::Kind::Closure:
+    case Node::Kind::String:
+    {
+        auto base = frames.empty() ? 0 : frames.back().updates;
+        for (auto i = base; i < updates.size(); i++) updates[i]->left = node;
+        updates.resize(base);
+
+        if (frames.empty()) return node;
+
+        auto value = std::move(node);
+        auto frame = std::move(frames.back());
+        frames.pop_back();
+        aliases = frame.aliases;
+        node = std::move(frame.node);
+
+        switch (frame.kind)
+        {
+        case Frame::Kind::Function:
+            node->kind = Node::Kind::Application;
+
+            if (value->kind == Node::Kind::Closure)
+            {
+                auto env = make_arena_shared<Environment>(node->right, value->env);
+
+                // Point the application at its unreduced body, so tail calls run in this loop
+                node->kind = Node::Kind::Indirection;
+                node->left = instantiate(program.nodes[value->index].left, env);
+                node->right = nullptr;
+                break;
+            }
+
+            enter(Frame::Kind::Argument, node, std::move(value), node->right);
+            break;
+
+        case Frame::Kind::Argument:
+            if (value->kind != Node::Kind::String)
+                throw evaluation_error(
+                    "Left side of application expression must not be a string "
+                    "unless right side is also a string in " + readBack(node)->toString() +
+                    " where Left side is "+ readBack(frame.function)->toString() +
+                    ", and Right side is " + readBack(value)->toString());
+
+            node->kind = Node::Kind::String;
+            node->str = frame.function->str + value->str;
+            node->left = nullptr;
+            node->right = nullptr;
+            break;
+
+        case Frame::Kind::Sequence:
+            node->kind = Node::Kind::Indirection;
+            node->left = std::move(node->right);
+            break;
+        }
+        break;
+    }
+
+    case Node::Kind::Indirection:
+        updates.push_back(node);
+        node = node->left;
+        break;
+
+    case Node::Kind::Global:
+        if (++aliases > globals.size())
+            throw evaluation_error("Infinite loop while evaluating " + program.globals[node->index].name.str());
+        node = global(node->index);
+        break;
+
+    case Node::Kind::Blackhole:
+        throw evaluation_error("Infinite loop while evaluating " + readBack(node)->toString());
+
+    case Node::Kind::Sequence:
+        enter(Frame::Kind::Sequence, node, nullptr, node->left);
+        break;
+
+    case Node::Kind::Application:
+        aliases = 0;
+        node->kind = Node::Kind::Blackhole;
+        enter(Frame::Kind::Function, node, nullptr, node->left);
+        break;
+    }
+}
+
+namespace
+{
+
+/// Reads back nodes, numbered by their position in nodes, and environments by theirs in envs
+class Reader : public IR::Reader
+{
+public:
+    using IR::Reader::Reader;
+
+    Handle of(NodePtr node)
+    {
+        nodes.push_back(std::move(node));
+        return nodes.size() - 1;
+    }
+
+protected:
+    void visit(Handle handle) override
+    {
+        const auto node = nodes[handle];
+
+        switch (node->kind)
+        {
+        case Node::Kind::Application:
+        case Node::Kind::Blackhole:
+            application(of(node->left), of(node->right));
+            return;
+
+        case Node::Kind::Closure:
+            envs.push_back(node->env);
+            term(node->index, envs.size() - 1);
+            return;
+
+        case Node::Kind::String:
+            expression(make_arena_shared<AST::String>(node->str));
+            return;
+
+        case Node::Kind::Global:
+            name(program.globals[node->index].name);
+            return;
+
+        case Node::Kind::Sequence:
+            alias(of(node->right));
+            return;
+
+        case Node::Kind::Indirection:
+            alias(of(node->left));
+            return;
+        }
+
+        throw std::logic_error("Unknown node kind");
+    }
+
+    Handle variable(Handle env, std::uint32_t index) override
+    { return of(lookup(envs[env], index)); }
+
+private:
+    std::vector<NodePtr> nodes;
+    std::vector<EnvironmentPtr> envs;
+};
+
+}
+
+AST::ExpressionPtr Evaluator::readBack(const NodePtr& node) const
+{
+    Reader reader(program);
+    return reader.read(reader.of(node));
+}
+
+}
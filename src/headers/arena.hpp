@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace LambdaCalc
+{
+
+/// @brief A region allocator. Memory is bumped out of large blocks, freed
+///        allocations are recycled by size, and everything is released at
+///        once by reset. Allocation sites use whichever arena is current on
+///        their thread, or the heap if there is none.
+class Arena
+{
+public:
+    static constexpr std::size_t blockSize = 1 << 16;
+    static constexpr std::size_t alignment = alignof(std::max_align_t);
+
+    /// @brief Allocations larger than this are not recycled until reset
+    static constexpr std::size_t maxRecycledSize = 512;
+
+    Arena() = default;
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    void* allocate(std::size_t size);
+    void deallocate(void* ptr, std::size_t size);
+
+    /// @brief Release every allocation. Nothing allocated in the arena may be used after this.
+    void reset();
+
+    /// @brief The bytes handed out since the last reset, including recycled memory
+    std::size_t bytesAllocated() const { return allocatedBytes; }
+
+    /// @brief The number of allocations since the last reset
+    std::size_t allocations() const { return allocationCount; }
+
+    /// @brief The bytes of blocks held by the arena
+    std::size_t bytesReserved() const;
+
+    /// @return The arena that allocations on this thread should use, or nullptr for the heap
+    static Arena* current();
+
+    /// @brief Makes an arena current on this thread while in scope.
+    ///        A Scope of nullptr makes allocations use the heap.
+    class Scope
+    {
+    public:
+        Scope(Arena* arena);
+        ~Scope();
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        Arena* previous;
+    };
+
+private:
+    struct FreeBlock { FreeBlock* next; };
+
+    std::vector<std::unique_ptr<std::byte[]>> blocks;
+    std::vector<std::size_t> blockSizes;
+    std::size_t block = 0;
+    std::byte* next = nullptr;
+    std::byte* end = nullptr;
+
+    FreeBlock* freeLists[maxRecycledSize / alignment + 1] = {};
+
+    std::size_t allocatedBytes = 0;
+    std::size_t allocationCount = 0;
+
+    static std::size_t roundUp(std::size_t size)
+    { return (size + alignment - 1) / alignment * alignment; }
+};
+
+/// @brief A standard allocator for the arena that is current when it is constructed
+template<typename T>
+class ArenaAllocator
+{
+public:
+    typedef T value_type;
+
+    Arena* arena;
+
+    ArenaAllocator() : arena(Arena::current()) {}
+
+    template<typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena) {}
+
+    T* allocate(std::size_t n)
+    {
+        if (!arena) return std::allocator<T>().allocate(n);
+        return static_cast<T*>(arena->allocate(n * sizeof(T)));
+    }
+
+    void deallocate(T* ptr, std::size_t n)
+    {
+        if (!arena) return std::allocator<T>().deallocate(ptr, n);
+        arena->deallocate(ptr, n * sizeof(T));
+    }
+
+    template<typename U>
+    bool operator==(const ArenaAllocator<U>& other) const { return arena == other.arena; }
+};
+
+/// @brief Make a shared_ptr in the current arena, or on the heap if there is none
+template<typename T, typename... Args>
+std::shared_ptr<T> make_arena_shared(Args&&... args)
+{ return std::allocate_shared<T>(ArenaAllocator<T>(), std::forward<Args>(args)...); }
+
+}
@@ -1,10 +1,16 @@
 #pragma once
 
+#include <cstdint>
 #include <memory>
 #include <string>
-#include <unordered_set>
+#include <string_view>
+#include <vector>
 
+#include "builtin.hpp"
+#include "lexer.hpp"
 #include "parser.hpp"
+#include "rope.hpp"
+#include "symbol.hpp"
 #include "util.hpp"
 
 namespace LambdaCalc::AST
@@ -19,23 +25,27 @@ class SimpleExpr;
 class Name;
 class String;
 class BracketExpr;
+class Builtin;
 
-const std::unordered_set<std::string> keywords {
-    "let",
-    "in",
-    "where"
-};
+typedef std::shared_ptr<const Expression> ExpressionPtr;
+
+/// @return true if symbol is one of the keywords "let", "in" or "where", which cannot be names
+bool isKeyword(Symbol symbol);
 
 class Line
 {
 public:
-    static std::unique_ptr<Line> parse(const char*& source);
+    static std::unique_ptr<Line> parse(const Token*& source);
 
     Line() {}
     virtual ~Line() = default;
 
     virtual std::string toString() const = 0;
 
+    /// @brief Nodes are allocated in the current Arena, or on the heap if there is none
+    static void* operator new(std::size_t size);
+    static void operator delete(void* ptr, std::size_t size);
+
 private:
 };
 
@@ -46,7 +56,7 @@ std::ostream& operator<<(std::ostream& os, const T& t)
 class Include : public Line
 {
 public:
-    static std::unique_ptr<Include> parse(const char*& source);
+    static std::unique_ptr<Include> parse(const Token*& source);
 
     std::string name;
 
@@ -55,39 +65,82 @@ public:
     std::string toString() const override;
 };
 
+/// @brief A `#builtin Name` line, binding a name to the native primitive of that name
+class BuiltinDecl : public Line
+{
+public:
+    static std::unique_ptr<BuiltinDecl> parse(const Token*& source);
+
+    Symbol name;
+
+    BuiltinDecl(Symbol name) : name(name) {}
+
+    std::string toString() const override;
+};
+
 class Comment : public Line
 {
 public:
-    static std::unique_ptr<Comment> parse(const char*& source);
+    static std::unique_ptr<Comment> parse(const Token*& source);
 
     Comment() {}
 
     std::string toString() const override;
 };
 
-class Expression : public Line
+class Expression : public Line, public std::enable_shared_from_this<Expression>
 {
 public:
-    static std::unique_ptr<Expression> parse(const char*& source);
+    static std::unique_ptr<Expression> parse(const Token*& source);
 
     Expression() {}
 
-    /// @return A base class unique_ptr to a copy of any concrete expression
-    virtual std::unique_ptr<Expression> getExpressionCopy() const = 0;
+    /// @brief A bloom filter of the names that occur free in this expression,
+    ///        computed when it is constructed. Bound names are not removed.
+    std::uint64_t freeNames = 0;
+
+    /// @return false if name certainly does not occur free in this expression
+    bool mayContain(Symbol name) const
+    { return freeNames & nameBit(name); }
+
+    static std::uint64_t nameBit(Symbol name)
+    { return std::uint64_t(1) << (name.id % 64); }
+
+    /// @return The free names of expr, which may be null while parsing fails
+    static std::uint64_t freeNamesOf(const Expression* expr)
+    { return expr ? expr->freeNames : 0; }
+
+    /// @return A copy of this expression and all of its children, in the current Arena
+    virtual ExpressionPtr deepCopy() const = 0;
 
     /// @brief Simplify this expression. Only call this function when evaluating
-    /// @return A unique_ptr to a simplified copy of this expression
-    virtual std::unique_ptr<Expression> simplify(
+    /// @return The simplified expression, sharing any unchanged parts of this one
+    virtual ExpressionPtr simplify(
         const BindingTable& bindings
     ) const;
 
     /// @brief Substitute a name with an expression in this expression
-    /// @return A unique_ptr to a copy of this expression, with the
-    ///         substitution made. 
-    virtual std::unique_ptr<Expression> substitute(
-        std::string name,
-        const Expression& expr
+    /// @return This expression with the substitution made. Unchanged subtrees are
+    ///         shared, and if nothing changed, this expression itself is returned.
+    virtual ExpressionPtr substitute(
+        Symbol name,
+        const ExpressionPtr& expr
     ) const = 0;
+
+    /// @brief A piece of the printed form of an expression:
+    ///        some text, or a subexpression to be printed in its place
+    struct Piece
+    {
+        std::string_view text;
+        const Expression* expr = nullptr;
+    };
+
+    /// @brief Print this expression with an explicit stack, so that however deep
+    ///        it is, it cannot overflow the native stack
+    std::string toString() const override;
+
+    /// @brief Append the pieces of the printed form of this expression, in order
+    virtual void pieces(std::vector<Piece>& out) const = 0;
 };
 
 /// @brief An expression that defines a local binding for use only in the expression.
@@ -96,36 +149,32 @@ public:
 class WhereExpr : public Expression
 {
 public:
-    std::unique_ptr<Expression> expr;
-    std::unique_ptr<Binding> binding;
+    ExpressionPtr expr;
+    std::shared_ptr<const Binding> binding;
 
     WhereExpr() {}
     WhereExpr(
-        std::unique_ptr<Expression> expr,
-        std::unique_ptr<Binding> binding
-    ) : expr(std::move(expr)),
-        binding(std::move(binding))
-    {}
+        ExpressionPtr expr,
+        std::shared_ptr<const Binding> binding
+    );
+    ~WhereExpr() override;
 
-    WhereExpr(const WhereExpr& other) :
-        expr(other.expr->getExpressionCopy()),
-        binding(std::make_unique<Binding>(*other.binding))
-    {}
+    ExpressionPtr deepCopy() const override;
 
-    std::unique_ptr<Expression> getExpressionCopy() const override 
-    { return std::make_unique<WhereExpr>(*this); }
-    
-    static std::unique_ptr<WhereExpr> parse(const char*& source); 
+    static std::unique_ptr<WhereExpr> parse(const Token*& source); 
+
+    /// @brief Parse an expression, qualified by any where bindings that follow it
+    static std::unique_ptr<Expression> parseQualified(const Token*& source);
 
-    std::unique_ptr<Expression> simplify(
+    ExpressionPtr simplify(
         const BindingTable& bindings
     ) const override;
 
-    std::string toString() const override;
+    void pieces(std::vector<Piece>& out) const override;
 
-    std::unique_ptr<Expression> substitute(
-        std::string name,
-        const Expression& expr
+    ExpressionPtr substitute(
+        Symbol name,
+        const ExpressionPtr& expr
     ) const override;
 };
 
@@ -135,82 +184,66 @@ public:
 class LetExpr : public Expression
 {
 public:
-    std::unique_ptr<Binding> binding;
-    std::unique_ptr<Expression> expr;
+    std::shared_ptr<const Binding> binding;
+    ExpressionPtr expr;
 
     LetExpr() {}
     LetExpr(
-        std::unique_ptr<Binding> binding,
-        std::unique_ptr<Expression> expr
-    ) : binding(std::move(binding)),
-        expr(std::move(expr))
-    {}
-
-    LetExpr(const LetExpr& other) :
-        binding(std::make_unique<Binding>(*other.binding)),
-        expr(other.expr->getExpressionCopy())
-    {}
+        std::shared_ptr<const Binding> binding,
+        ExpressionPtr expr
+    );
+    ~LetExpr() override;
 
-    std::unique_ptr<Expression> getExpressionCopy() const override 
-    { return std::make_unique<LetExpr>(*this); }
+    ExpressionPtr deepCopy() const override;
 
-    static std::unique_ptr<LetExpr> parse(const char*& source);
+    static std::unique_ptr<LetExpr> parse(const Token*& source);
 
-    std::unique_ptr<Expression> simplify(
+    ExpressionPtr simplify(
         const BindingTable& bindings
     ) const override;
 
-    std::string toString() const override;
+    void pieces(std::vector<Piece>& out) const override;
 
-    std::unique_ptr<Expression> substitute(
-        std::string name,
-        const Expression& expr
+    ExpressionPtr substitute(
+        Symbol name,
+        const ExpressionPtr& expr
     ) const override;
 };
 
 class ApplicationExpr : public Expression
 {
 public:
-    std::unique_ptr<Expression> left;
-    std::unique_ptr<SimpleExpr> right;
+    ExpressionPtr left;
+    std::shared_ptr<const SimpleExpr> right;
 
     ApplicationExpr() {}
     ApplicationExpr(
-        std::unique_ptr<Expression> left,
-        std::unique_ptr<SimpleExpr> right
-    ) : left(std::move(left)),
-        right(std::move(right))
-    {}
-
-    ApplicationExpr(const ApplicationExpr& other);
-
-    ApplicationExpr& operator=(const ApplicationExpr& other);
-
-    /// @brief Add a simple expression left of an application expression chain
-    static std::unique_ptr<ApplicationExpr> leftAppendSimpleExpr(
-        std::unique_ptr<SimpleExpr> leftSimpExpr,
-        std::unique_ptr<Expression> appExpr
+        ExpressionPtr left,
+        std::shared_ptr<const SimpleExpr> right
     );
+    ~ApplicationExpr() override;
 
-    std::string toString() const override;
+    void pieces(std::vector<Piece>& out) const override;
 
-    std::unique_ptr<Expression> getExpressionCopy() const override 
-    { return std::make_unique<ApplicationExpr>(*this); }
+    ExpressionPtr deepCopy() const override;
 
-    std::unique_ptr<Expression> simplify(
+    ExpressionPtr simplify(
         const BindingTable& bindings
     ) const override;
 
-    std::unique_ptr<Expression> substitute(
-        std::string name,
-        const Expression& expr
+    ExpressionPtr substitute(
+        Symbol name,
+        const ExpressionPtr& expr
     ) const override;
 };
 
 class SimpleExpr : public Expression
 {
 public:
-    static std::unique_ptr<SimpleExpr> parse(const char*& source);
+    static std::unique_ptr<SimpleExpr> parse(const Token*& source);
+
+    /// @brief Wrap an expression in brackets, unless it is already a simple expression
+    static std::shared_ptr<const SimpleExpr> wrap(ExpressionPtr expr);
 
     SimpleExpr() {}
 };
@@ -218,80 +251,102 @@ public:
 class Name : public SimpleExpr
 {
 public:
-    std::string name;
+    Symbol name;
 
     Name() {}
-    Name(std::string name) : name(name) {}
-    Name(const Name& other) : name(other.name) {}
+    Name(Symbol name) : name(name)
+    { freeNames = nameBit(name); }
 
-    std::string toString() const override;
+    void pieces(std::vector<Piece>& out) const override;
 
-    std::unique_ptr<Expression> getExpressionCopy() const override 
-    { return std::make_unique<Name>(*this); }
+    ExpressionPtr deepCopy() const override;
 
-    static std::unique_ptr<Name> parse(const char*& source);
+    static std::unique_ptr<Name> parse(const Token*& source);
 
-    std::unique_ptr<Expression> simplify(
+    ExpressionPtr simplify(
         const BindingTable& bindings
     ) const override;
 
-    std::unique_ptr<Expression> substitute(
-        std::string name,
-        const Expression& expr
+    ExpressionPtr substitute(
+        Symbol name,
+        const ExpressionPtr& expr
     ) const override;
 };
 
 class String : public SimpleExpr
 {
 public:
-    std::string str;
+    Rope str;
 
     String() {}
-    String(std::string str) : str(str) {}
-    String(const String& other) : str(other.str) {}
-
-    std::string toString() const override;
+    String(Rope str) : str(std::move(str)) {}
 
-    std::unique_ptr<Expression> getExpressionCopy() const override 
-    { return std::make_unique<String>(*this); }
+    void pieces(std::vector<Piece>& out) const override;
 
-    static std::unique_ptr<String> parse(const char*& source);
+    ExpressionPtr deepCopy() const override;
 
-    std::unique_ptr<Expression> simplify(
-        const BindingTable& bindings
-    ) const override { return getExpressionCopy(); }
+    static std::unique_ptr<String> parse(const Token*& source);
 
-    std::unique_ptr<Expression> substitute(
-        std::string name,
-        const Expression& expr
-    ) const override { return getExpressionCopy(); };
+    ExpressionPtr substitute(
+        Symbol name,
+        const ExpressionPtr& expr
+    ) const override { return shared_from_this(); };
 };
 
 class BracketExpr : public SimpleExpr
 {
 public:
-    std::unique_ptr<Expression> expr;
+    ExpressionPtr expr;
 
     BracketExpr() {}
-    BracketExpr(std::unique_ptr<Expression> expr) : expr(std::move(expr)) {}
-    BracketExpr(const BracketExpr& other) :
-        expr(other.expr->getExpressionCopy())
-    {}
+    BracketExpr(ExpressionPtr expr) : expr(std::move(expr))
+    { freeNames = freeNamesOf(this->expr.get()); }
+    ~BracketExpr() override;
 
-    std::string toString() const override;
+    void pieces(std::vector<Piece>& out) const override;
+
+    ExpressionPtr deepCopy() const override;
+
+    static std::unique_ptr<BracketExpr> parse(const Token*& source);
+
+    ExpressionPtr simplify(
+        const BindingTable& bindings
+    ) const override;
 
-    std::unique_ptr<Expression> getExpressionCopy() const override 
-    { return std::make_unique<BracketExpr>(*this); }
+    ExpressionPtr substitute(
+        Symbol name,
+        const ExpressionPtr& expr
+    ) const override;
+};
+
+/// @brief A native primitive applied to the arguments it has been given so far.
+///        Once it has all of them, simplifying it runs the primitive.
+class Builtin : public Expression
+{
+public:
+    const Builtins::Primitive* primitive;
+    std::vector<std::shared_ptr<const SimpleExpr>> args;
+
+    Builtin(
+        const Builtins::Primitive* primitive,
+        std::vector<std::shared_ptr<const SimpleExpr>> args = {}
+    );
+    ~Builtin() override;
+
+    /// @return This primitive applied to one more argument
+    std::shared_ptr<const Builtin> apply(std::shared_ptr<const SimpleExpr> arg) const;
 
-    static std::unique_ptr<BracketExpr> parse(const char*& source);
+    void pieces(std::vector<Piece>& out) const override;
 
-    std::unique_ptr<Expression> simplify(
+    ExpressionPtr deepCopy() const override;
+
+    ExpressionPtr simplify(
         const BindingTable& bindings
     ) const override;
 
-    std::unique_ptr<Expression> substitute(
-        std::string name,
-        const Expression& expr
+    ExpressionPtr substitute(
+        Symbol name,
+        const ExpressionPtr& expr
     ) const override;
 };
 
@@ -299,58 +354,46 @@ class Binding : public Line
 {
 public:
     Name from;
-    std::unique_ptr<Expression> to;
+    ExpressionPtr to;
 
     Binding() {}
     Binding(
         Name from,
-        std::unique_ptr<Expression> to
+        ExpressionPtr to
     ) : from(from),
         to(std::move(to))
     {}
-    Binding(const Binding& other) :
-        from(other.from),
-        to(other.to->getExpressionCopy())
-    {}
+    ~Binding() override;
 
     std::string toString() const override;
 
-    static std::unique_ptr<Binding> parse(const char*& source);
+    static std::unique_ptr<Binding> parse(const Token*& source);
 };
 
 class Mapping : public Expression
 {
 public:
     Name from;
-    std::unique_ptr<Expression> to;
+    ExpressionPtr to;
 
     Mapping() {}
     Mapping(
         Name from,
-        std::unique_ptr<Expression> to
+        ExpressionPtr to
     ) : from(from),
         to(std::move(to))
-    {}
-
-    Mapping(const Mapping& other) :
-        from(other.from),
-        to(other.to->getExpressionCopy())
-    {}
+    { freeNames = freeNamesOf(this->to.get()); }
+    ~Mapping() override;
 
-    std::string toString() const override;
+    void pieces(std::vector<Piece>& out) const override;
     
-    std::unique_ptr<Expression> getExpressionCopy() const override 
-    { return std::make_unique<Mapping>(*this); }
+    ExpressionPtr deepCopy() const override;
 
-    static std::unique_ptr<Mapping> parse(const char*& source);
-
-    std::unique_ptr<Expression> simplify(
-        const BindingTable& bindings
-    ) const override { return getExpressionCopy(); }
+    static std::unique_ptr<Mapping> parse(const Token*& source);
 
-    std::unique_ptr<Expression> substitute(
-        std::string name,
-        const Expression& expr
+    ExpressionPtr substitute(
+        Symbol name,
+        const ExpressionPtr& expr
     ) const override;
 };
 
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <optional>
+#include <utility>
+
+namespace LambdaCalc::Async
+{
+
+/// @brief The limits of an evaluation, each of which is unlimited if zero
+struct Budget
+{
+    /// @brief The steps to take before failing
+    std::uint64_t steps = 0;
+
+    /// @brief The bytes the current arena may reserve before failing, checked at each pause
+    std::size_t memory = 0;
+
+    /// @brief The steps to take between pauses
+    std::uint64_t slice = 1 << 14;
+};
+
+/// @brief A coroutine that results in a T, pausing between slices of its work. It starts
+///        paused, and only runs while it is resumed, on the thread resuming it.
+template<typename T>
+class Task
+{
+public:
+    struct promise_type
+    {
+        std::optional<T> value;
+        std::exception_ptr error;
+
+        Task get_return_object() { return Task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        void return_value(T result) { value = std::move(result); }
+        void unhandled_exception() { error = std::current_exception(); }
+    };
+
+    Task() = default;
+    Task(Task&& other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+
+    Task& operator=(Task&& other) noexcept
+    {
+        if (this != &other)
+        {
+            reset();
+            handle = std::exchange(other.handle, nullptr);
+        }
+        return *this;
+    }
+
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+
+    ~Task() { reset(); }
+
+    /// @brief Run until the next pause
+    /// @return Whether it has finished, by returning or throwing
+    bool resume()
+    {
+        if (!handle.done()) handle.resume();
+        return handle.done();
+    }
+
+    bool done() const { return !handle || handle.done(); }
+
+    /// @return The result, once it has finished
+    /// @throws What it threw
+    T result()
+    {
+        auto& promise = handle.promise();
+        if (promise.error) std::rethrow_exception(promise.error);
+        return std::move(*promise.value);
+    }
+
+    /// @brief Destroy the coroutine wherever it is paused, freeing everything it holds
+    void reset()
+    {
+        if (handle) handle.destroy();
+        handle = nullptr;
+    }
+
+private:
+    explicit Task(std::coroutine_handle<promise_type> handle) : handle(handle) {}
+
+    std::coroutine_handle<promise_type> handle;
+};
+
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <variant>
+#include <vector>
+
+#include "symbol.hpp"
+
+namespace LambdaCalc::Builtins
+{
+
+/// @brief The types of the arguments and results of primitives. Numbers are passed
+///        to and from lambda code as Church numerals, and booleans as `a -> b -> a`
+///        and `a -> b -> b`, so primitives fit in with the definitions in lambda/.
+enum class Type : std::uint8_t { String, Number, Bool };
+
+/// @brief A native argument or result of a primitive, holding its declared type
+typedef std::variant<std::string, std::uint64_t, bool> Datum;
+
+/// @brief A function implemented in C++, with a fixed arity, which lambda code can
+///        call once its name has been declared with `#builtin`
+class Primitive
+{
+public:
+    /// @brief The position of the primitive in the registry
+    std::uint32_t id;
+
+    Symbol name;
+    std::vector<Type> parameters;
+    Type result;
+
+    /// @brief Run the primitive on arguments of the types of its parameters
+    Datum (*apply)(const std::vector<Datum>& arguments);
+
+    std::size_t arity() const { return parameters.size(); }
+};
+
+/// @return The primitive with a name, or nullptr if there is none
+const Primitive* find(Symbol name);
+
+/// @return The primitive with an id
+const Primitive& get(std::uint32_t id);
+
+}
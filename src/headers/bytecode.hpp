@@ -0,0 +1,125 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "ast.hpp"
+#include "ir.hpp"
+#include "machine.hpp"
+
+namespace LambdaCalc::Bytecode
+{
+
+/// @brief An instruction's operation. Each block of code is a run of Arg and Let
+///        instructions, building up the application spine of a term, ended by one of
+///        StrictLet, Var, Global, Builtin, Closure or String, which produces its head.
+enum class Op : std::uint8_t
+{
+    ArgThunk,       ///< Push an argument: a thunk of the IR term operand
+    ArgVar,         ///< Push an argument: the thunk bound to variable operand
+    ArgClosure,     ///< Push an argument: a closure of the IR lambda operand
+    ArgString,      ///< Push an argument: the string operand
+    LetThunk,       ///< Bind a thunk of the IR term operand
+    LetVar,         ///< Bind the thunk bound to variable operand
+    LetClosure,     ///< Bind a closure of the IR lambda operand
+    LetString,      ///< Bind the string operand
+    StrictLet,      ///< Bind a thunk of the value of the IR StrictLet operand, and evaluate
+                    ///< it before running the block of its body
+    Var,            ///< Enter the thunk bound to variable operand
+    Global,         ///< Enter the thunk of the global in slot operand
+    Builtin,        ///< Run the primitive of the IR Builtin operand
+    Closure,        ///< Return a closure of the IR lambda operand
+    String          ///< Return the string operand
+};
+
+constexpr std::size_t opCount = std::size_t(Op::String) + 1;
+
+class Instruction
+{
+public:
+    Op op;
+
+    /// @brief A de Bruijn index, slot, IR index, or index into IR::Program::strings
+    std::uint32_t operand;
+
+    /// @brief The address of the VM's handler for op, once the code is threaded
+    const void* handler = nullptr;
+};
+
+/// @brief Bytecode compiled from the IR. Each term's block is compiled the
+///        first time it is run, and kept for as long as the program is.
+class Code
+{
+public:
+    /// @brief While held alongside a Program::Scratch, drops the blocks compiled for the
+    ///        program's scratch nodes once released, as other terms will take their places.
+    ///        Their instructions are dropped too, unless blocks of the program's own
+    ///        terms were compiled after them.
+    class Scratch
+    {
+    public:
+        Scratch(Code& code, const IR::Program& program);
+        ~Scratch();
+
+        Scratch(const Scratch&) = delete;
+        Scratch& operator=(const Scratch&) = delete;
+
+    private:
+        Code& code;
+        std::size_t instructions;
+    };
+
+    std::vector<Instruction> instructions;
+
+    /// @return The position of the block of a term, compiling it if need be
+    std::uint32_t block(const IR::Program& program, IR::Index term)
+    {
+        if (term < blocks.size() && blocks[term] != IR::none) return blocks[term];
+        return compile(program, term);
+    }
+
+    /// @brief Point the handler of each new instruction at the VM's handler for its op
+    void thread(const void* const* handlers)
+    {
+        for (; threaded < instructions.size(); threaded++)
+            instructions[threaded].handler = handlers[std::size_t(instructions[threaded].op)];
+    }
+
+private:
+    std::uint32_t compile(const IR::Program& program, IR::Index term);
+
+    /// @brief The position of the block of each IR term, or IR::none if it is not compiled
+    std::vector<std::uint32_t> blocks;
+
+    /// @brief The number of instructions already threaded
+    std::size_t threaded = 0;
+
+    /// @brief While a scratch is held, the first of the program's scratch nodes, the
+    ///        scratch terms compiled, and whether any other term was compiled after them
+    IR::Index scratchNodes = IR::none;
+    std::vector<IR::Index> scratchTerms;
+    bool kept = false;
+};
+
+/// @brief A lazy machine that runs bytecode with direct-threaded dispatch.
+///        It takes the steps of Machine::Core between blocks, as Machine::Evaluator
+///        does between IR nodes, so it evaluates exactly as it does, numeral operations
+///        and primitives included, but does not interpret the IR.
+class VM : private Machine::Core
+{
+public:
+    VM(IR::Program& program, Code& code) : Core(program), program(program), code(code) {}
+
+    /// @brief Evaluate an expression to weak head normal form
+    /// @return The value, read back into an expression
+    AST::ExpressionPtr evaluate(const AST::Expression& expr);
+
+private:
+    IR::Program& program;
+    Code& code;
+
+    Machine::ValuePtr run(IR::Index root);
+};
+
+}
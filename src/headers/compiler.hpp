@@ -0,0 +1,57 @@
+#pragma once
+
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "ast.hpp"
+#include "ir.hpp"
+#include "runtime.hpp"
+
+namespace LambdaCalc
+{
+
+class compile_error : public std::runtime_error
+{
+public:
+    compile_error(std::string what) :
+        std::runtime_error(what)
+    {}
+};
+
+/// @brief Compiles a lambda module, and every module it includes, into C++ source.
+///        The source defines a native function for each term that can be run, and
+///        links against the Runtime, so the program neither parses nor walks an AST.
+class Compiler
+{
+public:
+    IR::Program program;
+
+    /// @brief The bindings and the expressions to evaluate and print, in the order they
+    ///        are read, so that a global bound again later is not seen by earlier expressions
+    std::vector<Runtime::Step> steps;
+
+    /// @brief The modules already included, which are not included again
+    std::unordered_set<std::string> includes;
+
+    /// @brief Read the bindings and expressions of a module, and of the modules it
+    ///        includes, in the order Interpreter::run would
+    /// @throws compile_error if a module cannot be opened or a line cannot be parsed
+    void include(const std::string& name);
+
+    /// @brief Add an expression to evaluate after those already read
+    void evaluate(const AST::Expression& expr);
+
+    /// @brief Write the C++ source of the program
+    void emit(std::ostream& out) const;
+};
+
+/// @brief Write C++ source that embeds the parsed lines of modules, but not of the
+///        modules they include, so that an interpreter linked with it can include
+///        them without their source
+/// @throws compile_error if a module cannot be opened or a line cannot be parsed
+void embed(std::ostream& out, const std::vector<std::string>& modules);
+
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ast.hpp"
+#include "ir.hpp"
+#include "rope.hpp"
+
+namespace LambdaCalc::Graph
+{
+
+class Node;
+class Environment;
+
+typedef std::shared_ptr<Node> NodePtr;
+typedef std::shared_ptr<const Environment> EnvironmentPtr;
+
+/// @brief The graph nodes bound to the variables of a closure, innermost first
+class Environment
+{
+public:
+    NodePtr node;
+    EnvironmentPtr next;
+
+    Environment(NodePtr node, EnvironmentPtr next) :
+        node(std::move(node)),
+        next(std::move(next))
+    {}
+
+    ~Environment();
+};
+
+/// @brief A node of the program graph. Applications are thunks: once reduced,
+///        they are overwritten with an indirection to their value, so every
+///        reference to them shares the result.
+class Node
+{
+public:
+    enum class Kind
+    {
+        Application,    ///< left right, not yet reduced
+        Closure,        ///< index is a Lambda, with its variables bound in env
+        String,         ///< A string value
+        Global,         ///< A reference to the global in slot index
+        Sequence,       ///< Reduce left, then reduce to right
+        Indirection,    ///< A reduced node, whose value is left
+        Blackhole       ///< An application whose function is being reduced
+    };
+
+    Kind kind;
+    NodePtr left;
+    NodePtr right;
+    IR::Index index = 0;
+    EnvironmentPtr env;
+    Rope str;
+
+    Node(Kind kind, NodePtr left = nullptr, NodePtr right = nullptr) :
+        kind(kind),
+        left(std::move(left)),
+        right(std::move(right))
+    {}
+
+    Node(Rope str) : kind(Kind::String), str(std::move(str)) {}
+
+    Node(Kind kind, IR::Index index, EnvironmentPtr env = nullptr) :
+        kind(kind),
+        index(index),
+        env(std::move(env))
+    {}
+
+    ~Node();
+};
+
+/// @brief A call-by-need evaluator, reducing a graph instantiated from the IR.
+///        Arguments and where bindings are shared, so each is reduced at most once.
+class Evaluator
+{
+public:
+    Evaluator(IR::Program& program) : program(program) {}
+
+    /// @brief Evaluate an expression to weak head normal form
+    /// @return The value, read back into an expression
+    AST::ExpressionPtr evaluate(const AST::Expression& expr);
+
+private:
+    IR::Program& program;
+
+    /// @brief The graph of each global used, shared by every reference to it
+    std::vector<NodePtr> globals;
+
+    NodePtr global(IR::Slot slot);
+
+    NodePtr instantiate(IR::Index index, const EnvironmentPtr& env);
+
+    NodePtr reduce(NodePtr node);
+
+    /// @brief Read a node back into an expression. Shared nodes read back as far as they
+    ///        have been reduced, so a lambda may read back differently from how substitution
+    ///        prints it, though it is equivalent. Strings read back the same.
+    AST::ExpressionPtr readBack(const NodePtr& node) const;
+};
+
+}
@@ -2,20 +2,162 @@
 
 #include <unordered_map>
 #include <unordered_set>
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
 #include <iostream>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
 
+#include "arena.hpp"
 #include "ast.hpp"
+#include "async.hpp"
+#include "bytecode.hpp"
+#include "ir.hpp"
+#include "module.hpp"
+#include "parallel.hpp"
 
 namespace LambdaCalc
 {
 
+/// @brief Reads and parses modules on a pool of threads, ahead of the interpreter
+///        including them. The modules a module includes start loading as soon as it
+///        has been parsed, so modules that do not include each other are parsed at
+///        once, while the interpreter still runs them one at a time, in order.
+class ModuleLoader
+{
+public:
+    /// @brief A line of a module, or if it could not be parsed, nullptr and its source
+    struct Line
+    {
+        std::shared_ptr<const AST::Line> line;
+        std::string source;
+    };
+
+    /// @brief The lines of a module, which has none if it could not be found
+    struct Loaded
+    {
+        bool found = false;
+        std::vector<Line> lines;
+    };
+
+    /// @brief The names a module binds and the modules it includes, without its lines
+    struct Outline
+    {
+        bool found = false;
+        std::vector<Symbol> bound;
+        std::vector<std::string> includes;
+    };
+
+    /// @brief Whether loading a module prefetches the modules it includes. Lazy interpreters
+    ///        clear it, as the modules they defer are only loaded if they are run.
+    bool eager = true;
+
+    ModuleLoader(unsigned threads = std::thread::hardware_concurrency());
+    ~ModuleLoader();
+
+    ModuleLoader(const ModuleLoader&) = delete;
+    ModuleLoader& operator=(const ModuleLoader&) = delete;
+
+    /// @brief Start loading a module, unless it has been already
+    void prefetch(const std::string& name);
+
+    /// @return A module, once it has been loaded. It is loaded on this thread if no
+    ///         worker has started on it yet.
+    const Loaded& get(const std::string& name);
+
+    /// @return The outline of a module. Its source is scanned for the first tokens of each
+    ///         line rather than parsed, and a module embedded in the interpreter, which has
+    ///         no source, is read from its cache.
+    Outline outline(const std::string& name);
+
+private:
+    enum class State { Queued, Loading, Done };
+
+    struct Entry
+    {
+        std::string name;
+        State state = State::Queued;
+        Loaded loaded;
+    };
+
+    std::mutex mutex;
+    std::condition_variable queued;
+    std::condition_variable done;
+    std::unordered_map<std::string, std::unique_ptr<Entry>> modules;
+    std::deque<Entry*> queue;
+    std::vector<std::thread> workers;
+    bool stopping = false;
+
+    void work();
+
+    /// @brief Read a module from its file, its cache, or the modules embedded in the
+    ///        interpreter, then prefetch the modules it includes
+    void load(Entry& entry);
+};
+
 /// @brief An interface for a lambda-calculus interpreter.
 class Interpreter
 {
 public:
+    /// @brief The strategies available for evaluating expressions
+    enum class Engine
+    {
+        Substitution,   ///< Expression::simplify, substituting arguments into each use
+        Graph,          ///< Call-by-need graph reduction, sharing arguments between uses
+        Machine,        ///< A lazy abstract machine, binding arguments in environments
+        Bytecode        ///< The abstract machine, running bytecode compiled from the IR
+    };
+
     BindingTable bindings;
     std::unordered_set<std::string> includes;
+    Engine engine = Engine::Substitution;
+
+    /// @brief Report the memory allocated by each evaluation
+    bool stats = false;
+
+    /// @brief The pool the substitution engine simplifies the arguments of strings at once on,
+    ///        or nullptr to simplify everything on this thread
+    std::shared_ptr<Parallel::Pool> pool;
+
+    /// @brief The steps and memory each evaluation with the machine engine may use
+    Async::Budget budget;
+
+    /// @brief The bindings, lowered for the graph, machine and bytecode engines
+    IR::Program program;
+
+    /// @brief The bytecode compiled from program so far
+    Bytecode::Code code;
+
+    /// @brief Loads the modules included, shared with the interpreters of those modules.
+    ///        One is made on the first include if none is given.
+    std::shared_ptr<ModuleLoader> loader;
+
+    /// @brief Defer running the modules that included modules include, until a name is
+    ///        used in a namespace they define, like `List` for `List::And`. Their
+    ///        expressions are only evaluated then.
+    bool lazy = false;
+
+    /// @brief The modules included lazily that have not been run yet
+    struct Deferred
+    {
+        /// @brief The modules that define names in each namespace, in the order they were included
+        std::unordered_map<std::string, std::vector<std::string>> namespaces;
+
+        /// @brief Each module, and the time it was deferred at, which it runs as of
+        std::unordered_map<std::string, std::uint64_t> modules;
+
+        /// @brief The time each name in the bindings was last bound at, so that a module
+        ///        deferred before then does not replace it, as it would not have eagerly
+        std::unordered_map<Symbol::Id, std::uint64_t> bound;
+
+        /// @brief Counts the bindings made and the modules deferred while including lazily
+        std::uint64_t clock = 0;
+    } deferred;
 
     /// @brief Runs the interpreter
     /// @param initialBindings The variables already bound in the enclosing scope
@@ -26,8 +168,49 @@ public:
         const std::unordered_set<std::string>* const initialIncludes = nullptr
     );
 
+    /// @brief Start from the state of an interpreter that has finished running, sharing
+    ///        the expressions it bound rather than copying them as run would. Its tables
+    ///        are still copied: a pointer for each binding, and its IR and bytecode, so
+    ///        this takes time in proportion to how much its modules bound.
+    void inherit(const Interpreter& base);
+
 protected:
 
+    /// @brief Holds the nodes made while parsing and evaluating a line
+    Arena arena;
+
+    /// @brief The names bound, in the order they were first bound, which is the order an
+    ///        include binds them in. Symbols are interned by whichever thread parses them
+    ///        first, so the order of their ids changes from run to run.
+    std::vector<Symbol> order;
+
+    /// @brief Whether the includes of this interpreter are deferred, as it runs a module
+    ///        included by a lazy interpreter
+    bool defer = false;
+
+    /// @brief Bind a name to a copy of an expression, replacing any previous binding
+    void bind(Symbol name, const AST::Expression& expression);
+
+    /// @brief Run a module, and bind the names it defines
+    /// @param deferredAt The time the module was deferred at, if it was, so that it binds
+    ///        only the names that have not been bound since
+    void include(const std::string& name, std::uint64_t deferredAt = 0);
+
+    /// @brief Index the namespaces defined by a module, and the modules it includes,
+    ///        to run each of them once a name in one of its namespaces is used
+    void deferInclude(const std::string& name);
+
+    /// @brief Run the deferred modules that define the unbound names an expression
+    ///        uses, directly or through the bindings it uses
+    void resolve(const AST::Expression& expression);
+
+    /// @brief Evaluate an expression with the selected engine
+    AST::ExpressionPtr evaluate(const AST::Expression& expression);
+
+    /// @brief Read and parse the next line, or print an error if it cannot be parsed
+    /// @return The line, or nullptr if it could not be parsed
+    virtual std::shared_ptr<const AST::Line> next();
+
     /// @brief Read a line of code to interpret
     virtual std::string read() = 0;
 
@@ -67,6 +250,43 @@ protected:
     bool end() override;
 };
 
+/// @brief Reads the lines of source, joining those that end in `\`, without interpreting them
+class LineReader : public StreamInterpreter
+{
+public:
+    LineReader(std::istream& input) : StreamInterpreter(input) {}
+
+    using StreamInterpreter::read;
+    using StreamInterpreter::end;
+};
+
+/// @brief Interprets the lines of a module that a ModuleLoader has read and parsed
+class ModuleInterpreter : public Interpreter
+{
+protected:
+    const ModuleLoader::Loaded& module;
+    std::size_t position = 0;
+    std::ostream& output;
+    std::ostream& error;
+
+public:
+    ModuleInterpreter(
+        const ModuleLoader::Loaded& module,
+        std::ostream& output = std::cout,
+        std::ostream& error = std::cerr
+    ) : module(module),
+        output(output),
+        error(error)
+    {}
+
+protected:
+    std::shared_ptr<const AST::Line> next() override;
+    std::string read() override;
+    void print(std::string message) override;
+    void print_error(std::string message) override;
+    bool end() override;
+};
+
 class Repl : public StreamInterpreter
 {
 public:
@@ -82,4 +302,25 @@ protected:
     void print_error(std::string message) override;
 };
 
-}
\ No newline at end of file
+/// @brief Evaluates independent expressions on a pool of threads, against the bindings
+///        of an interpreter that has finished running, which are then only read. Each
+///        worker copies the table of bindings, so that it memoizes their simplified forms
+///        in its own, and copies the IR and bytecode, which evaluating adds to.
+class Batch
+{
+public:
+    Batch(const Interpreter& loaded, unsigned threads = std::thread::hardware_concurrency()) :
+        loaded(loaded),
+        threads(std::max(threads, 1u))
+    {}
+
+    /// @brief Evaluate each line of input, printing the results and errors in the order
+    ///        of the lines, each as soon as those before it have been printed
+    void run(std::istream& input, std::ostream& output, std::ostream& error);
+
+private:
+    const Interpreter& loaded;
+    unsigned threads;
+};
+
+}
@@ -0,0 +1,290 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "ast.hpp"
+
+namespace LambdaCalc::IR
+{
+
+/// @brief The position of a node in Program::nodes
+typedef std::uint32_t Index;
+
+/// @brief The position of a global in Program::globals
+typedef std::uint32_t Slot;
+
+/// @brief An index that refers to no node
+constexpr Index none = UINT32_MAX;
+
+/// @brief A term lowered from the AST. Variables are de Bruijn indices, counting the
+///        Lambda and Let nodes between them and their binder, and globals are slots.
+class Node
+{
+public:
+    enum class Kind : std::uint8_t
+    {
+        Variable,       ///< value is the de Bruijn index
+        Global,         ///< value is the slot
+        Lambda,         ///< value is the parameter's symbol, binding it in left
+        Application,    ///< left applied to right
+        String,         ///< value is the string
+        Let,            ///< value is the symbol, bound to left in right, shared lazily
+        StrictLet,      ///< value is the symbol, bound to left in right, evaluated first
+        Builtin         ///< value is the id of a primitive, run on the innermost variables.
+                        ///< A primitive returning a boolean has its true lambda in left and
+                        ///< its false lambda in right.
+    };
+
+    Kind kind;
+
+    /// @brief The de Bruijn index, slot, symbol id, primitive id, or index into Program::strings
+    std::uint32_t value;
+
+    Index left = 0;
+    Index right = 0;
+};
+
+/// @brief A global binding, lowered into the program
+class Global
+{
+public:
+    Symbol name;
+
+    /// @brief The root node of its definition, or none if it is undefined
+    Index root = none;
+};
+
+class Program;
+
+/// @brief The globals of a program that define Church numerals and arithmetic on them,
+///        recognised by the structure of their definitions rather than their names,
+///        so that the machine can run them on native integers.
+class Numerals
+{
+public:
+    enum class Op : std::uint8_t
+    {
+        None,
+        Zero,       ///< Not an operation, but a lambda of zero
+        Successor,  ///< Not an operation, but the lambda of a successor, binding its predecessor
+        Add,        ///< a -> b -> a Incr b
+        Mult,       ///< a -> b -> a (Add b) 0
+        IsZero,     ///< n -> n (_ -> False) True
+        Decr,       ///< The predecessor, by iterating on a pair
+        Sub         ///< a -> b -> b Decr a
+    };
+
+    /// @brief The lambda of zero, `f -> x -> x`, which numbers are built from
+    Index zero = none;
+
+    /// @brief The lambda of a successor applied to its predecessor, `f -> x -> f (n f x)`,
+    ///        whose closure binds the predecessor, which numbers are built from
+    Index incr = none;
+
+    /// @brief Find the numerals and operations defined by the program's globals
+    void recognise(Program& program);
+
+    /// @return The operation run when a closure of a lambda is applied to its last argument
+    Op op(Index lambda) const
+    { return lambda < ops.size() ? ops[lambda] : Op::None; }
+
+    /// @return A node applying an operation's global to its arguments: the variables
+    ///         1 and 0 for the first and second of two, or the variable 0 for one
+    Index call(Op op) const
+    { return calls[std::size_t(op)]; }
+
+private:
+    std::vector<Op> ops;
+    std::array<Index, 8> calls = { none, none, none, none, none, none, none, none };
+};
+
+/// @brief Terms lowered from the AST, stored contiguously.
+///        Where bindings behave as they do when substituted: their free names
+///        are captured by the mappings at the head of the expression they qualify.
+class Program
+{
+public:
+    /// @brief While held, the expressions lowered into the program are only kept until it
+    ///        is released, so that evaluating them does not grow the program for good.
+    ///        Scratches may overlap, as interleaved evaluations do, in which case the
+    ///        nodes of all of them are dropped once the last is released.
+    class Scratch
+    {
+    public:
+        Scratch(Program& program);
+        ~Scratch();
+
+        Scratch(const Scratch&) = delete;
+        Scratch& operator=(const Scratch&) = delete;
+
+    private:
+        Program& program;
+    };
+
+    std::vector<Node> nodes;
+    std::vector<std::string> strings;
+    std::vector<Global> globals;
+
+    /// @brief The numerals found by the last call to Numerals::recognise
+    Numerals numerals;
+
+    /// @brief Recognise the numerals again, if a global has been defined since they last were
+    void recognise();
+
+    /// @return The slot of the global with a name, adding one if there is none
+    Slot slot(Symbol name);
+
+    /// @brief Lower an expression and bind it to a global, replacing any previous definition.
+    ///        Nothing may be defined while a scratch is held.
+    void define(Symbol name, const AST::Expression& expr);
+
+    /// @brief Lower an expression into the program
+    /// @return The index of its root node
+    Index lower(const AST::Expression& expr);
+
+private:
+    /// @brief The slot of each global, indexed by its symbol
+    std::vector<Slot> slots;
+    std::unordered_map<std::string, std::uint32_t> stringIds;
+
+    /// @brief Whether numerals were recognised after the last definition
+    bool recognised = false;
+
+    /// @brief The scratches held, and the sizes of nodes and strings when the first was
+    std::size_t scratches = 0;
+    std::size_t scratchNodes = 0;
+    std::size_t scratchStrings = 0;
+
+    std::uint32_t string(const std::string& str);
+
+    Index push(Node node);
+
+    Index lower(const AST::Expression& expr, std::vector<Symbol>& scope);
+    Index lowerWhere(const AST::WhereExpr& where, std::vector<Symbol>& scope);
+    Index lowerBuiltin(const AST::Builtin& builtin, std::vector<Symbol>& scope);
+};
+
+/// @brief Reads the values of an engine back into expressions. The terms of closures are
+///        raised with their where bindings substituted, and the values bound to their free
+///        variables are read back in place of the variables. Terms and the values they refer
+///        to are walked with one explicit stack, so neither may be arbitrarily deep.
+///        A binder whose name would capture a name free in its body, or one bound further
+///        out, is renamed with a number, as `y -> y` is read back as `y1 -> y` when the inner
+///        y is a global.
+class Reader
+{
+public:
+    /// @brief A value or an environment of the engine, by a numbering of its own
+    typedef std::uint32_t Handle;
+
+    Reader(const Program& program) : program(program) {}
+    virtual ~Reader() = default;
+
+    /// @brief Read a value back into an expression
+    AST::ExpressionPtr read(Handle value);
+
+protected:
+    const Program& program;
+
+    /// @brief Say what a value reads back as, by calling exactly one of expression, name,
+    ///        term, application or alias
+    virtual void visit(Handle value) = 0;
+
+    /// @return The value bound to a variable of an environment, by its de Bruijn index
+    virtual Handle variable(Handle env, std::uint32_t index) = 0;
+
+    /// @brief The value reads back as an expression with no free names, such as a string
+    void expression(AST::ExpressionPtr expr);
+
+    /// @brief The value reads back as a free name, such as that of a global
+    void name(Symbol name);
+
+    /// @brief The value is a term, whose free variables are bound in env
+    void term(Index root, Handle env);
+
+    /// @brief The value is one value applied to another
+    void application(Handle left, Handle right);
+
+    /// @brief The value reads back as another value
+    void alias(Handle value);
+
+private:
+    /// @brief An expression being read back, before its binders are named. Where bindings
+    ///        are substituted by referring to the item of their value wherever they are used.
+    struct Item
+    {
+        enum class Kind
+        {
+            Expression, ///< expr
+            Name,       ///< A free name
+            Variable,   ///< A variable bound by binder
+            Apply,      ///< The first child applied to the second
+            Lambda,     ///< binder -> the first child
+            Let,        ///< let binder = the first child in the second
+            Builtin     ///< primitive applied to its arity of children
+        } kind;
+
+        Symbol name;
+        std::uint32_t binder = 0;
+        AST::ExpressionPtr expr;
+        const Builtins::Primitive* primitive = nullptr;
+
+        /// @brief The position of the first child in children
+        std::uint32_t first = 0;
+    };
+
+    /// @brief A variable bound by a Lambda or StrictLet node, and the name it reads back as
+    struct Binder
+    {
+        Symbol name;
+        bool renamed = false;
+    };
+
+    /// @brief A variable bound in a term: its binder, or for where bindings, the item it stands for
+    struct Bound
+    {
+        std::uint32_t binder;
+        std::uint32_t value;
+    };
+
+    /// @brief A value to visit, or a node of a term to raise. Nodes with children are visited
+    ///        again after each of them is raised, and applications of values once both sides are.
+    struct Task
+    {
+        enum class Kind { Value, Node, Apply } kind;
+        Handle handle;  ///< The value, or the environment of the term
+        Index index = none;
+        int visit = 0;
+        std::size_t base = 0;   ///< The variables bound outside the term
+    };
+
+    std::vector<Item> items;
+    std::vector<std::uint32_t> children;
+    std::vector<Binder> binders;
+
+    std::vector<Bound> bound;
+    std::vector<Task> tasks;
+
+    /// @brief The items read back, whose parents have yet to be
+    std::vector<std::uint32_t> results;
+
+    /// @brief Add an item, whose children are the last results read back
+    void push(Item item, std::size_t arity = 0);
+
+    /// @brief Read back a variable of the term of a task, now or by pushing the value bound to it
+    void resolve(const Task& task, std::uint32_t index);
+
+    void raise(const Task& task);
+
+    /// @brief Rename the binders that would capture a name, walking the items from root
+    void rename(std::uint32_t root);
+
+    AST::ExpressionPtr build(std::uint32_t root);
+};
+
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+namespace LambdaCalc
+{
+
+/// @brief A token of source code, whose text is a span of the source it was read from
+class Token
+{
+public:
+    enum class Kind : std::uint8_t
+    {
+        Name,       ///< A name or a keyword, made of letters, digits, `_` and `:`
+        String,     ///< text is the string between the quotes
+        Directive,  ///< text is the word after `#`, as in `#include`
+        Arrow,      ///< `->`
+        Equals,     ///< `=`
+        Comma,      ///< `,`
+        Dollar,     ///< `$`
+        Open,       ///< `(`
+        Close,      ///< `)`
+        Comment,    ///< `//` up to the end of the line
+        Invalid,    ///< A character that starts no token, or an unterminated string
+        End         ///< The end of the source, which always ends the tokens
+    };
+
+    Kind kind;
+    std::string_view text;
+};
+
+/// @brief Split source code into tokens, ending with an End token.
+///        Lexing stops after an Invalid token, which no parser accepts.
+///        The tokens refer to the source, which must outlive them.
+std::vector<Token> tokenize(std::string_view source);
+
+}
@@ -0,0 +1,278 @@
+#pragma once
+
+#include <deque>
+#include <exception>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "arena.hpp"
+#include "ast.hpp"
+#include "async.hpp"
+#include "ir.hpp"
+#include "rope.hpp"
+
+namespace LambdaCalc::Machine
+{
+
+class Value;
+class Thunk;
+class Environment;
+
+typedef std::shared_ptr<const Value> ValuePtr;
+typedef std::shared_ptr<Thunk> ThunkPtr;
+typedef std::shared_ptr<const Environment> EnvironmentPtr;
+
+/// @brief The thunks bound to the variables in scope, innermost first.
+///        Binding a variable pushes a frame, so beta-reduction is O(1).
+class Environment
+{
+public:
+    ThunkPtr thunk;
+    EnvironmentPtr next;
+
+    Environment(ThunkPtr thunk, EnvironmentPtr next) :
+        thunk(std::move(thunk)),
+        next(std::move(next))
+    {}
+
+    ~Environment();
+};
+
+/// @brief The result of evaluating a term: a closure, a string, or a Church numeral
+///        held as a native integer
+class Value
+{
+public:
+    enum class Kind { Closure, String, Number };
+
+    Kind kind;
+    IR::Index lambda = IR::none;
+    EnvironmentPtr env;
+    Rope str;
+
+    /// @brief A number is this many successors of base, or of zero if base is null.
+    ///        The base is left unevaluated until something needs it.
+    std::uint64_t number = 0;
+    ThunkPtr base;
+
+    Value(IR::Index lambda, EnvironmentPtr env) :
+        kind(Kind::Closure),
+        lambda(lambda),
+        env(std::move(env))
+    {}
+
+    Value(Rope str) : kind(Kind::String), str(std::move(str)) {}
+
+    Value(std::uint64_t number, ThunkPtr base) :
+        kind(Kind::Number),
+        number(number),
+        base(std::move(base))
+    {}
+
+    ~Value();
+};
+
+/// @brief A term suspended in its environment, updated with its value once evaluated
+class Thunk
+{
+public:
+    IR::Index term = IR::none;
+    EnvironmentPtr env;
+    ValuePtr value;
+    bool entered = false;
+
+    /// @brief A thunk entered in tail position, while this one was being evaluated,
+    ///        has the same value as it. Its value is taken from alias once it is updated.
+    ThunkPtr alias;
+
+    Thunk(IR::Index term, EnvironmentPtr env) : term(term), env(std::move(env)) {}
+    Thunk(ValuePtr value) : value(std::move(value)) {}
+
+    ~Thunk();
+};
+
+/// @brief What to do with a value once the machine has evaluated it
+class Frame
+{
+public:
+    enum class Kind
+    {
+        Argument,   ///< Apply the value to thunk
+        Update,     ///< Store the value in thunk
+        Concat,     ///< Evaluate thunk, which must be a string, and append it to value
+        Sequence,   ///< Discard the value, and evaluate term in env
+        Native      ///< Run the numeral operation of the lambda term, or the primitive of the
+                    ///< builtin term, again on the arguments in env
+    };
+
+    Kind kind;
+    ThunkPtr thunk;
+    ValuePtr value;
+    IR::Index term = IR::none;
+    EnvironmentPtr env;
+};
+
+/// @brief The state of a lazy machine, and the steps it takes however its terms are run:
+///        entering thunks, passing values to the frames on its stack, and running numeral
+///        operations and primitives natively. Evaluator interprets the IR between these
+///        steps, Bytecode::VM runs bytecode and Runtime::Evaluator code compiled by lambdac.
+class Core
+{
+public:
+    Core(const IR::Program& program) : program(program) {}
+
+    /// @brief The value being passed to the stack, or null while term is run in env
+    ValuePtr value;
+    IR::Index term = IR::none;
+    EnvironmentPtr env;
+    std::vector<Frame> stack;
+
+    /// @brief A thunk for each global used, so that each is evaluated at most once
+    std::vector<ThunkPtr> globals;
+
+    /// @return The thunk of the global in a slot
+    const ThunkPtr& global(IR::Slot slot);
+
+    /// @brief Continue with the value of a thunk, running its term first if need be
+    void enter(ThunkPtr thunk);
+
+    /// @brief Bind a thunk to the next variable, and evaluate it before running body
+    void sequence(ThunkPtr thunk, IR::Index body);
+
+    /// @brief Pass value to the frame on top of the stack, which leaves either a value to
+    ///        pass on or a term to run
+    /// @return False if the stack is empty, so value is the result
+    bool pass();
+
+    /// @brief Run the primitive of a builtin node, whose arguments are bound in env, and
+    ///        continue with its result. Until each argument is known, it is forced and the
+    ///        node run again.
+    void primitive(IR::Index builtin);
+
+protected:
+    const IR::Program& program;
+
+private:
+    /// @brief Run the numeral operation of a lambda, whose body is term and whose arguments
+    ///        are bound in env, and continue with its result. An argument is only forced where
+    ///        the lambda would force it, and then the operation is run again once it is known.
+    /// @return False if an argument is not a numeral, so the body must be run instead
+    bool operate(IR::Index lambda);
+};
+
+/// @brief A lazy Krivine machine: closures carry environments and variables are
+///        looked up rather than substituted. Its stack lives on the heap, so
+///        evaluation depth is bounded by memory rather than the native stack.
+///        Update frames are never stacked on each other, so tail calls through
+///        thunks, as in List::Foldl, run in constant stack space.
+///        Applying the numeral operations of IR::Numerals runs them on native
+///        integers, forcing no more of their arguments than the lambdas would.
+///        Primitives force each of their arguments in turn, then run natively.
+///        It runs as a coroutine that pauses every slice of steps of a budget.
+class Evaluator : private Core
+{
+public:
+    Evaluator(IR::Program& program) : Core(program), program(program) {}
+
+    /// @brief Evaluate an expression to weak head normal form
+    /// @return The value, read back into an expression
+    /// @throws evaluation_error If it exceeds the budget
+    AST::ExpressionPtr evaluate(const AST::Expression& expr, const Async::Budget& budget = {});
+
+    /// @brief Lower an expression and start evaluating it, a slice of steps each time the
+    ///        task is resumed. The evaluator must outlive the task, and a Program::Scratch
+    ///        held while it runs keeps the expression's nodes from staying in the program.
+    Async::Task<ValuePtr> start(const AST::Expression& expr, Async::Budget budget = {});
+
+    /// @return The steps taken so far
+    std::uint64_t steps() const { return taken; }
+
+private:
+    IR::Program& program;
+    std::uint64_t taken = 0;
+
+    /// @brief Suspend a term, reusing existing thunks for variables
+    ThunkPtr suspend(IR::Index term, const EnvironmentPtr& env);
+
+    /// @brief Holds no reference into the program while paused, so other evaluations
+    ///        may lower into it between slices
+    Async::Task<ValuePtr> run(IR::Index root, Async::Budget budget);
+};
+
+/// @brief An evaluation that runs a slice of steps each time it is resumed, in an arena
+///        of its own, so that many can be interleaved on one thread, and any of them
+///        stopped between slices, freeing the stack it has built
+class Evaluation
+{
+public:
+    /// @param program The program to lower into, which must outlive the evaluation
+    Evaluation(IR::Program& program, const AST::Expression& expr, Async::Budget budget = {});
+
+    Evaluation(const Evaluation&) = delete;
+    Evaluation& operator=(const Evaluation&) = delete;
+
+    /// @brief Run the next slice of steps
+    /// @return Whether it has finished, by reaching a value, failing or being cancelled
+    bool resume();
+
+    bool done() const { return finished; }
+
+    /// @brief Stop the evaluation, if it has not finished
+    void cancel();
+
+    /// @return The value, read back into an expression on the heap, so that it may
+    ///         outlive the evaluation
+    /// @throws What evaluating it threw, or evaluation_error if it was cancelled
+    AST::ExpressionPtr result() const;
+
+    /// @return The steps taken so far
+    std::uint64_t steps() const { return evaluator.steps(); }
+
+private:
+    IR::Program& program;
+    Arena arena;
+
+    /// @brief Holds the nodes lowered for the expression until it has finished
+    std::optional<IR::Program::Scratch> scratch;
+
+    Evaluator evaluator;
+    Async::Task<ValuePtr> task;
+    AST::ExpressionPtr value;
+    std::exception_ptr error;
+    bool finished = false;
+};
+
+/// @brief Interleaves evaluations on one thread, resuming each in turn for a slice
+class Scheduler
+{
+public:
+    void add(std::shared_ptr<Evaluation> evaluation) { pending.push_back(std::move(evaluation)); }
+
+    /// @brief Resume each unfinished evaluation once, dropping those that finish
+    /// @return Whether any are left unfinished
+    bool step();
+
+    /// @brief Resume the evaluations until all of them have finished
+    void run() { while (step()); }
+
+private:
+    std::deque<std::shared_ptr<Evaluation>> pending;
+};
+
+/// @return The closure a number stands for, `f -> x -> f (n f x)` or `f -> x -> x`
+ValuePtr expand(const IR::Program& program, const Value& number);
+
+/// @brief Read a value back into an expression. Thunks read back as far as they have been
+///        evaluated, so a lambda may read back differently from how substitution prints it,
+///        though it is equivalent. Strings read back the same.
+AST::ExpressionPtr readBack(const IR::Program& program, const ValuePtr& value);
+
+/// @brief Read a thunk back into an expression, whether or not it has been evaluated
+AST::ExpressionPtr readBack(const IR::Program& program, const ThunkPtr& thunk);
+
+/// @return The thunk bound to a variable, by its de Bruijn index
+const ThunkPtr& lookup(const EnvironmentPtr& env, std::uint32_t index);
+
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "ast.hpp"
+
+namespace LambdaCalc::Module
+{
+
+/// @brief Bumped whenever the serialized form of lines changes, so that caches
+///        written by other versions of the interpreter are ignored
+constexpr std::uint32_t formatVersion = 2;
+
+/// @brief Bumped whenever the AST, or how lines are parsed into it, changes. Caches hold
+///        parsed lines, so those parsed by other versions of the interpreter are ignored.
+constexpr std::uint32_t astVersion = 1;
+
+/// @return The FNV-1a hash of a module's source, which its cache is keyed by
+std::uint64_t hash(std::string_view source);
+
+/// @return The path of the cache of a module, next to its source
+std::string cachePath(const std::string& name);
+
+/// @brief The cache of a module, embedded in the executable when it was built, so that
+///        the module can be included without reading or parsing its source
+struct Embedded
+{
+    const char* name;
+    const unsigned char* data;
+    std::size_t size;
+
+    /// @return The embedded module with a name, or nullptr if there is none
+    static const Embedded* find(const std::string& name);
+};
+
+/// @brief Makes a table of embedded modules findable. The table is constant, so this
+///        is all that is done with it at startup.
+class Library
+{
+public:
+    Library(const Embedded* modules, std::size_t count);
+};
+
+/// @brief Serializes the lines of a module as they are parsed, so that later runs
+///        can load them without parsing. Each expression is written in post-order,
+///        so it can be read back with an explicit stack, however deep it is.
+class Writer
+{
+public:
+    /// @brief Record a line. Comments are not recorded, as they do nothing.
+    void write(const AST::Line& line);
+
+    /// @brief Stop recording, as a line could not be parsed
+    void fail() { failed = true; }
+
+    /// @brief Write the cache of a module with a source hash, unless a line failed to
+    ///        parse. It is written to a temporary file and renamed into place, so a
+    ///        reader never sees it half written. Failing to write it is not an error.
+    void save(const std::string& path, std::uint64_t sourceHash) const;
+
+    /// @return The cache of a module with a source hash, as save would write it
+    std::string serialize(std::uint64_t sourceHash) const;
+
+private:
+    std::string bytes;
+    bool failed = false;
+
+    void expression(const AST::Expression& expr);
+    void number(std::uint64_t n);
+    void text(std::string_view str);
+};
+
+/// @brief A module cache mapped into memory, which reads its lines back in order
+class Reader
+{
+public:
+    /// @return The cache at a path, if it exists and was written from the source
+    ///         with a hash by this version of the interpreter, or nullptr
+    static std::unique_ptr<Reader> open(const std::string& path, std::uint64_t sourceHash);
+
+    /// @return The cache of an embedded module, or nullptr if it was written by
+    ///         another version of the interpreter
+    static std::unique_ptr<Reader> open(const Embedded& module);
+
+    Reader(const Reader&) = delete;
+    Reader& operator=(const Reader&) = delete;
+    ~Reader();
+
+    bool end() const { return position == size; }
+
+    /// @brief Read the next line, allocating it in the current Arena
+    std::shared_ptr<const AST::Line> next();
+
+private:
+    Reader(const char* data, std::size_t size, bool mapped) : data(data), size(size), mapped(mapped) {}
+
+    const char* data;
+    std::size_t size;
+    bool mapped;
+    std::size_t position = 0;
+
+    /// @return Whether the header has the format and AST versions, and if given, the source hash
+    bool valid(const std::uint64_t* sourceHash);
+
+    std::uint8_t byte();
+    std::uint64_t number();
+    std::string_view text();
+};
+
+}
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "util.hpp"
+
+namespace LambdaCalc::Parallel
+{
+
+typedef std::shared_ptr<const AST::Expression> ExpressionPtr;
+
+/// @brief Thrown out of a task whose result is no longer needed
+class cancelled : public std::exception
+{
+public:
+    const char* what() const noexcept override { return "Cancelled"; }
+};
+
+/// @brief A pool of threads that Expression::simplify forks subterms onto, so that they
+///        are simplified while it simplifies others. Each worker simplifies with its own
+///        copy of the bindings, so that it memoizes in its own table, and allocates on
+///        the heap, as its results outlive its tasks.
+class Pool
+{
+public:
+    explicit Pool(unsigned threads = std::thread::hardware_concurrency());
+    ~Pool();
+
+    Pool(const Pool&) = delete;
+    Pool& operator=(const Pool&) = delete;
+
+    /// @return The pool that evaluations on this thread fork onto, or nullptr if they do not
+    static Pool* current();
+
+    /// @brief Makes a pool current on this thread while in scope, for an evaluation with
+    ///        a table of bindings, which must not be bound to until the scope ends
+    class Scope
+    {
+    public:
+        Scope(Pool* pool, const BindingTable& bindings);
+        ~Scope();
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        Pool* previous;
+    };
+
+    /// @return Whether every worker already has a task waiting for it, so that forking
+    ///         more would only queue them behind others
+    bool saturated();
+
+    /// @brief Throw cancelled if the task being simplified on this thread, or the one
+    ///        that forked it, has been cancelled
+    static void interruptionPoint();
+
+private:
+    friend class Fork;
+
+    struct Task
+    {
+        enum class State { Queued, Running, Done };
+
+        ExpressionPtr expr;
+        ExpressionPtr result;
+        std::exception_ptr error;
+        State state = State::Queued;
+        std::atomic<bool> cancelled = false;
+
+        /// @brief The task that forked this one, which outlives it
+        const Task* parent = nullptr;
+    };
+
+    std::mutex mutex;
+    std::condition_variable queued;
+    std::condition_variable done;
+    std::deque<Task*> queue;
+    std::vector<std::thread> workers;
+    bool stopping = false;
+
+    /// @brief The bindings of the current evaluation, and a number that changes with each,
+    ///        so that workers know when to copy them again
+    const BindingTable* bindings = nullptr;
+    std::uint64_t generation = 0;
+
+    /// @brief The task being simplified on this thread, if any
+    static thread_local const Task* currentTask;
+
+    void work();
+
+    /// @brief Simplify the expression of a task on this thread, keeping its result or error
+    void run(Task& task, const BindingTable& bindings);
+};
+
+/// @brief An expression being simplified on a pool. It is simplified by whichever thread
+///        gets to it first: a worker, or the one that joins it.
+class Fork
+{
+public:
+    Fork(Pool& pool, ExpressionPtr expr);
+    ~Fork() { cancel(); }
+
+    Fork(const Fork&) = delete;
+    Fork& operator=(const Fork&) = delete;
+
+    /// @return The simplified expression, once it has been simplified
+    /// @throws What simplifying the expression threw
+    ExpressionPtr join(const BindingTable& bindings);
+
+    /// @brief Stop simplifying the expression, as its result is not needed,
+    ///        and wait for any worker simplifying it to stop
+    void cancel();
+
+private:
+    Pool& pool;
+    Pool::Task task;
+    bool finished = false;
+};
+
+}
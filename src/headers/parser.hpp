@@ -2,7 +2,9 @@
 
 #include <memory>
 #include <concepts>
+#include <string>
 
+#include "lexer.hpp"
 #include "ast.hpp"
 
 namespace LambdaCalc
@@ -10,8 +12,8 @@ namespace LambdaCalc
 
 /// @brief A type that can be parsed
 template<typename P>
-concept Parseable = requires (const char*& str) {
-    { P::parse(str) } -> std::same_as<std::unique_ptr<P>>;
+concept Parseable = requires (const Token*& tokens) {
+    { P::parse(tokens) } -> std::same_as<std::unique_ptr<P>>;
 };
 
 /// @brief A helper class for parsing classes that implement the Parseable concept
@@ -19,17 +21,14 @@ template<Parseable P>
 class Parser
 {
 public:
-    /// @brief The same as parse(const char*& source), but with the added assurance
-    ///        that the entire source string has been parsed, if nullptr is not returned
+    /// @brief Tokenize source and parse a P from all of it. If nullptr is not
+    ///        returned, the entire source string has been parsed, and is cleared.
     static std::unique_ptr<P> parse(std::string& source);
 
-    /// @brief Parse a P and update the pointer to the remaining source code.
+    /// @brief Parse a P and advance past the tokens it was parsed from.
     ///        But if no P is parsed, i.e. the return value is nullptr, then
-    ///        source is guaranteed to be unchanged.
-    static std::unique_ptr<P> parse(const char*& source);
+    ///        tokens is guaranteed to be unchanged.
+    static std::unique_ptr<P> parse(const Token*& tokens);
 };
 
-/// @brief Remove all whitespace characters at the start of a string
-void remove_leading_whitespace(const char*& source);
-
-}
\ No newline at end of file
+}
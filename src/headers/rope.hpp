@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace LambdaCalc
+{
+
+/// @brief An immutable string which is concatenated in O(1), by sharing both halves
+///        rather than copying them. It is only copied out into one string when read,
+///        so building a long string a piece at a time takes linear time.
+///        Segments are allocated in the current Arena, or on the heap if there is none.
+class Rope
+{
+public:
+    /// @brief Short concatenations are copied into one segment, rather than shared
+    static constexpr std::size_t maxCopiedSize = 64;
+
+    Rope() = default;
+    Rope(std::string str);
+    Rope(const char* str) : Rope(std::string(str)) {}
+
+    /// @return The concatenation of two ropes, sharing their segments
+    friend Rope operator+(const Rope& left, const Rope& right);
+
+    std::size_t size() const { return root ? root->size : 0; }
+    bool empty() const { return !root; }
+
+    /// @brief Call f(std::string_view) on each piece of text in order, with an explicit
+    ///        stack, so that however many concatenations made the rope, it cannot overflow
+    template<typename F>
+    void forEachSegment(F&& f) const
+    {
+        std::vector<const Segment*> stack;
+        if (root) stack.push_back(root.get());
+
+        while (!stack.empty())
+        {
+            auto segment = stack.back();
+            stack.pop_back();
+
+            if (!segment->left)
+            {
+                f(std::string_view(segment->text));
+                continue;
+            }
+
+            stack.push_back(segment->right.get());
+            stack.push_back(segment->left.get());
+        }
+    }
+
+    /// @return The whole string, copied out of the segments
+    std::string flatten() const;
+
+private:
+    /// @brief Either some text, or the concatenation of left and right
+    class Segment
+    {
+    public:
+        std::string text;
+        std::shared_ptr<const Segment> left;
+        std::shared_ptr<const Segment> right;
+        std::size_t size;
+
+        Segment(std::string text) : text(std::move(text)), size(this->text.size()) {}
+        Segment(std::shared_ptr<const Segment> left, std::shared_ptr<const Segment> right) :
+            left(std::move(left)),
+            right(std::move(right)),
+            size(this->left->size + this->right->size)
+        {}
+
+        ~Segment();
+    };
+
+    std::shared_ptr<const Segment> root;
+};
+
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "ir.hpp"
+#include "machine.hpp"
+
+namespace LambdaCalc::Runtime
+{
+
+class Evaluator;
+
+/// @brief The native code of a term, compiled ahead of time by lambdac.
+///        It builds the term's application spine, then enters or returns its head.
+typedef void (*Block)(Evaluator& evaluator);
+
+/// @brief A line of a module compiled by lambdac: binding the global in slot to the term
+///        root, or if slot is IR::none, evaluating the term root and printing its value
+class Step
+{
+public:
+    IR::Slot slot;
+    IR::Index root;
+};
+
+/// @brief A module compiled by lambdac. The IR is kept to read values back,
+///        and for each term that can be run, blocks holds its native code.
+class Module
+{
+public:
+    const IR::Node* nodes;
+    std::size_t nodeCount;
+
+    /// @brief The names bound by the Lambda, Let and StrictLet nodes, which
+    ///        hold an index into names rather than a symbol
+    const char* const* names;
+    std::size_t nameCount;
+
+    const char* const* strings;
+    std::size_t stringCount;
+
+    /// @brief The name of each global, by slot
+    const char* const* globals;
+    std::size_t globalCount;
+
+    /// @brief The bindings and expressions of the modules, in the order they were read,
+    ///        so that each expression sees the globals as they were bound at that point
+    const Step* steps;
+    std::size_t stepCount;
+
+    /// @brief The code of each node, or nullptr if it is never run
+    const Block* blocks;
+};
+
+/// @brief Evaluate each expression of a compiled module and print it, as bin/main would
+/// @return The exit code of the program
+int run(const Module& module);
+
+/// @brief The lazy machine of Machine::Evaluator, running native blocks of code
+///        rather than interpreting the IR. Compiled blocks call its operations,
+///        and it takes the steps of Machine::Core between them.
+class Evaluator : private Machine::Core
+{
+public:
+    Evaluator(const IR::Program& program, const Block* blocks) :
+        Core(program),
+        blocks(blocks)
+    { globals.resize(program.globals.size()); }
+
+    /// @brief Evaluate a term to weak head normal form
+    Machine::ValuePtr evaluate(IR::Index term);
+
+    /// @return The thunk bound to a variable
+    const Machine::ThunkPtr& var(std::uint32_t index) const
+    { return Machine::lookup(env, index); }
+
+    /// @return A thunk of a term in the current environment
+    Machine::ThunkPtr thunk(IR::Index term) const;
+
+    /// @return An evaluated thunk of a closure of a lambda
+    Machine::ThunkPtr closure(IR::Index lambda) const;
+
+    /// @return An evaluated thunk of a string
+    Machine::ThunkPtr string(std::uint32_t id) const;
+
+    /// @brief Apply the head of the spine to a thunk
+    void arg(Machine::ThunkPtr thunk);
+
+    /// @brief Bind a thunk to the next variable
+    void let(Machine::ThunkPtr thunk);
+
+    /// @brief Bind a thunk of value to the next variable, and evaluate it before body
+    void strictLet(IR::Index value, IR::Index body);
+
+    /// @brief Continue with the value of a thunk, evaluating it first if need be
+    using Core::enter;
+
+    void enterGlobal(IR::Slot slot);
+
+    /// @brief Continue with a closure of a lambda
+    void returnClosure(IR::Index lambda);
+
+    /// @brief Continue with a string
+    void returnString(std::uint32_t id);
+
+private:
+    const Block* blocks;
+};
+
+}
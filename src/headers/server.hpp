@@ -0,0 +1,23 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+
+#include "interpreter.hpp"
+
+namespace LambdaCalc::Server
+{
+
+/// @brief Accept requests on a Unix socket at a path until killed. A request is the
+///        source of a module, which is run by an interpreter of its own, starting from
+///        the bindings of base. Those are only read, so each request runs on a thread
+///        of its own, and what it binds is dropped once it has been answered.
+/// @return An exit status, if the socket could not be listened on
+int serve(const Interpreter& base, const std::string& path);
+
+/// @brief Send source to the server listening at a path, and print what it printed
+///        while running it, to output and error as it did
+/// @return An exit status: 0, or 1 if the server could not be reached
+int request(const std::string& path, const std::string& source, std::ostream& output, std::ostream& error);
+
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace LambdaCalc
+{
+
+/// @brief A name interned in a process-wide table, so that it can be compared,
+///        hashed and used as an index as a 32-bit integer. Interned names are
+///        never released, and a name always interns to the same symbol.
+class Symbol
+{
+public:
+    typedef std::uint32_t Id;
+
+    Id id = 0;
+
+    /// @brief The symbol of the empty name
+    Symbol() = default;
+
+    /// @brief Intern a name
+    explicit Symbol(const std::string& name);
+
+    /// @return The symbol that was interned with an id
+    static Symbol fromId(Id id)
+    {
+        Symbol symbol;
+        symbol.id = id;
+        return symbol;
+    }
+
+    /// @return The name this symbol was interned from
+    const std::string& str() const;
+
+    /// @return The number of symbols interned so far, which bounds every id
+    static std::size_t count();
+
+    bool operator==(const Symbol& other) const = default;
+};
+
+}
@@ -1,10 +1,16 @@
 #pragma once
 
 #include <memory>
+#include <string>
+#include <vector>
+
+#include "symbol.hpp"
 
 namespace LambdaCalc
 {
 
+namespace AST { class Expression; }
+
 /// @brief Try to dynamic cast a unique_ptr, return nullptr if it cannot be done
 template<typename T, typename S>
 std::unique_ptr<T> dynamic_pointer_cast(std::unique_ptr<S>&& p) noexcept
@@ -14,9 +20,103 @@ std::unique_ptr<T> dynamic_pointer_cast(std::unique_ptr<S>&& p) noexcept
     return converted;
 }
 
-typedef std::unordered_map<
-    std::string,
-    std::unique_ptr<AST::Expression>
-> BindingTable;
+/// @brief Release a shared pointer without recursing into the objects it owns.
+///        Types whose destructors release their shared members through this are
+///        destroyed in a loop, so long chains of them cannot overflow the stack.
+inline void release(std::shared_ptr<const void> ptr)
+{
+    thread_local std::vector<std::shared_ptr<const void>> pending;
+    thread_local bool releasing = false;
+
+    // Unless this is the last reference, dropping it destroys nothing
+    if (!ptr || ptr.use_count() > 1) return;
+
+    pending.push_back(std::move(ptr));
+    if (releasing) return;
+
+    releasing = true;
+    while (!pending.empty())
+    {
+        // Destroying the last one may add its members to pending
+        auto last = std::move(pending.back());
+        pending.pop_back();
+    }
+    releasing = false;
+}
+
+/// @brief The expressions bound to global names, indexed directly by their symbol
+class BindingTable
+{
+public:
+    typedef std::shared_ptr<const AST::Expression> ExpressionPtr;
+
+    /// @return The expression bound to a symbol, or nullptr if it is unbound
+    const ExpressionPtr& at(Symbol symbol) const
+    {
+        const static ExpressionPtr unbound;
+        return symbol.id < expressions.size() ? expressions[symbol.id] : unbound;
+    }
+
+    bool contains(Symbol symbol) const
+    { return at(symbol) != nullptr; }
+
+    /// @brief Bind a symbol to an expression, replacing any previous binding.
+    ///        This forgets every memoized form, as they may depend on the old binding.
+    void bind(Symbol symbol, ExpressionPtr expression)
+    {
+        if (symbol.id >= expressions.size()) expressions.resize(symbol.id + 1);
+        expressions[symbol.id] = std::move(expression);
+        memos.clear();
+    }
+
+    /// @return The simplified form of a binding, or nullptr if it has not been memoized
+    const ExpressionPtr& memoized(Symbol symbol) const
+    {
+        const static ExpressionPtr none;
+        const auto& memo = symbol.id < memos.size() ? memos[symbol.id] : none;
+
+        if (memo) memoHits++;
+        else memoMisses++;
+
+        return memo;
+    }
+
+    /// @brief Remember the simplified form of a binding, until the table is next bound to
+    void memoize(Symbol symbol, ExpressionPtr simplified) const
+    {
+        if (symbol.id >= memos.size()) memos.resize(symbol.id + 1);
+        memos[symbol.id] = std::move(simplified);
+    }
+
+    /// @return A copy of the bindings without their memoized forms, for another thread to
+    ///         memoize in while this table is in use
+    BindingTable snapshot() const
+    {
+        BindingTable copy;
+        copy.expressions = expressions;
+        return copy;
+    }
+
+    /// @brief The number of lookups of memoized forms that were found
+    std::size_t hits() const { return memoHits; }
+
+    /// @brief The number of lookups of memoized forms that were not found
+    std::size_t misses() const { return memoMisses; }
+
+    /// @brief Call f(symbol, expression) for each binding, in the order the symbols were interned
+    template<typename F>
+    void forEach(F&& f) const
+    {
+        for (Symbol::Id id = 0; id < expressions.size(); id++)
+            if (expressions[id]) f(Symbol::fromId(id), expressions[id]);
+    }
+
+private:
+    std::vector<ExpressionPtr> expressions;
+
+    mutable std::vector<ExpressionPtr> memos;
+    mutable std::size_t memoHits = 0;
+    mutable std::size_t memoMisses = 0;
+};
 
 }
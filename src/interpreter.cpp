@@ -1,11 +1,23 @@
 #include <unordered_map>
 #include <iostream>
 #include <fstream>
+#include <iterator>
 #include <sstream>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 #include <memory>
+#include <stdexcept>
 
 #include "headers/interpreter.hpp"
+#include "headers/arena.hpp"
+#include "headers/builtin.hpp"
+#include "headers/bytecode.hpp"
 #include "headers/evaluator.hpp"
+#include "headers/graph.hpp"
+#include "headers/machine.hpp"
 #include "headers/ast.hpp"
 
 #include "parser.cpp"
@@ -17,42 +29,73 @@ BindingTable Interpreter::run(
     const BindingTable* const initialBindings,
     const std::unordered_set<std::string>* const initialIncludes
 ) {
-    if (initialBindings) bindings = *initialBindings;
+    if (initialBindings)
+        initialBindings->forEach([&](Symbol name, const AST::ExpressionPtr& expr)
+        { bind(name, *expr); });
     if (initialIncludes) includes = *initialIncludes;
 
     while (!end())
     {
-        auto source = read();
+        // Everything made while parsing and evaluating a line is garbage once it is done
+        arena.reset();
+        Arena::Scope scope(&arena);
 
-        auto line = Parser<AST::Line>::parse(source);
+        auto line = next();
+        if (!line) continue;
 
-        if (!line || source.length() > 0)
-        {
-            print_error("Unable to parse: \"" + source + "\"");
-            continue;
-        }
-
-        if (auto binding = dynamic_cast<AST::Binding*>(line.get()))
+        if (auto binding = dynamic_cast<const AST::Binding*>(line.get()))
         {
             if (bindings.contains(binding->from.name))
                 print_error(
                     "Warning: "
-                    "Shadowing binding `" + binding->from.name
+                    "Shadowing binding `" + binding->from.name.str()
                 );
 
-            bindings[binding->from.name] = binding->to->getExpressionCopy();
+            bind(binding->from.name, *binding->to);
+            if (lazy) deferred.bound[binding->from.name.id] = ++deferred.clock;
+        }
+
+        if (auto builtin = dynamic_cast<const AST::BuiltinDecl*>(line.get()))
+        {
+            if (auto primitive = Builtins::find(builtin->name))
+            {
+                if (bindings.contains(builtin->name))
+                    print_error(
+                        "Warning: "
+                        "Shadowing binding `" + builtin->name.str()
+                    );
+
+                bind(builtin->name, AST::Builtin(primitive));
+                if (lazy) deferred.bound[builtin->name.id] = ++deferred.clock;
+            }
+            else print_error("Builtin Error: There is no builtin `" + builtin->name.str() + "`");
         }
         
-        if (auto expression = dynamic_cast<AST::Expression*>(line.get()))
+        // Expressions are shared, so that evaluating them can share their nodes
+        if (auto expression = std::dynamic_pointer_cast<const AST::Expression>(line))
         try
         {
-            print(expression->simplify(bindings)->toString());
-        } catch (evaluation_error e)
+            if (!deferred.modules.empty()) resolve(*expression);
+
+            auto hits = bindings.hits(), misses = bindings.misses();
+
+            print(evaluate(*expression)->toString());
+
+            if (stats)
+                print_error(
+                    "Allocated " + std::to_string(arena.bytesAllocated()) +
+                    " bytes in " + std::to_string(arena.allocations()) +
+                    " allocations, " + std::to_string(arena.bytesReserved()) +
+                    " bytes reserved, memoized bindings: " +
+                    std::to_string(bindings.hits() - hits) + " hits, " +
+                    std::to_string(bindings.misses() - misses) + " misses"
+                );
+        } catch (const evaluation_error& e)
         {
             print_error("Evaluation error: " + std::string(e.what()));
         }
 
-        if (auto include = dynamic_cast<AST::Include*>(line.get()))
+        if (auto include = dynamic_cast<const AST::Include*>(line.get()))
         {
             if (includes.contains(include->name))
             {
@@ -60,34 +103,436 @@ BindingTable Interpreter::run(
                 continue;
             }
             
-            std::ifstream include_file(include->name + ".lambda");
-            if (include_file.fail())
+            if (defer) this->deferInclude(include->name);
+            else this->include(include->name);
+        }
+    }
+
+    return bindings;
+}
+
+/// Share a parsed line. Expressions are shared as their own type, so that they can share themselves.
+static std::shared_ptr<const AST::Line> share(std::unique_ptr<AST::Line> line)
+{
+    if (auto expression = dynamic_pointer_cast<AST::Expression>(std::move(line)))
+        return AST::ExpressionPtr(std::move(expression));
+
+    return line;
+}
+
+/// Read the lines of a module from its cache, or return false if the cache is corrupt
+static bool readCache(Module::Reader& reader, std::vector<ModuleLoader::Line>& lines)
+try
+{
+    while (!reader.end()) lines.push_back({ reader.next(), "" });
+    return true;
+} catch (const std::runtime_error&)
+{
+    lines.clear();
+    return false;
+}
+
+ModuleLoader::ModuleLoader(unsigned threads)
+{
+    for (unsigned i = 0; i < std::max(threads, 1u); i++)
+        workers.emplace_back([this]() { work(); });
+}
+
+ModuleLoader::~ModuleLoader()
+{
+    {
+        std::lock_guard lock(mutex);
+        stopping = true;
+    }
+
+    queued.notify_all();
+    for (auto& worker : workers) worker.join();
+}
+
+void ModuleLoader::prefetch(const std::string& name)
+{
+    {
+        std::lock_guard lock(mutex);
+        auto& entry = modules[name];
+        if (entry) return;
+
+        entry = std::make_unique<Entry>();
+        entry->name = name;
+        queue.push_back(entry.get());
+    }
+
+    queued.notify_one();
+}
+
+const ModuleLoader::Loaded& ModuleLoader::get(const std::string& name)
+{
+    prefetch(name);
+
+    std::unique_lock lock(mutex);
+    auto& entry = *modules.at(name);
+
+    // Rather than wait for a worker to get to it, load it here
+    if (entry.state == State::Queued)
+    {
+        entry.state = State::Loading;
+        lock.unlock();
+        load(entry);
+        lock.lock();
+
+        entry.state = State::Done;
+        done.notify_all();
+    }
+
+    done.wait(lock, [&]() { return entry.state == State::Done; });
+    return entry.loaded;
+}
+
+void ModuleLoader::work()
+{
+    std::unique_lock lock(mutex);
+
+    while (true)
+    {
+        queued.wait(lock, [&]() { return stopping || !queue.empty(); });
+        if (stopping) return;
+
+        auto& entry = *queue.front();
+        queue.pop_front();
+        if (entry.state != State::Queued) continue;
+
+        entry.state = State::Loading;
+        lock.unlock();
+        load(entry);
+        lock.lock();
+
+        entry.state = State::Done;
+        done.notify_all();
+    }
+}
+
+void ModuleLoader::load(Entry& entry)
+{
+    // The lines outlive the line that includes them, so must not be in its arena
+    Arena::Scope scope(nullptr);
+
+    auto& loaded = entry.loaded;
+    std::ifstream file(entry.name + ".lambda");
+
+    if (file.fail())
+    {
+        // A module embedded in the interpreter is only used when there is no file to override it
+        auto embedded = Module::Embedded::find(entry.name);
+        auto reader = embedded ? Module::Reader::open(*embedded) : nullptr;
+        loaded.found = reader && readCache(*reader, loaded.lines);
+    }
+    else
+    {
+        loaded.found = true;
+
+        std::string source((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        auto hash = Module::hash(source);
+        auto cachePath = Module::cachePath(entry.name);
+
+        // A module is parsed once, and loaded from its cache until its source changes
+        auto reader = Module::Reader::open(cachePath, hash);
+        if (!reader || !readCache(*reader, loaded.lines))
+        {
+            std::istringstream input(source);
+            LineReader lines(input);
+            Module::Writer writer;
+
+            while (!lines.end())
             {
-                print_error("Include Error: Failed to open file: \""+include->name+".lambda\"");
-                continue;
+                auto text = lines.read();
+                std::unique_ptr<AST::Line> line = Parser<AST::Line>::parse(text);
+
+                if (!line || text.length() > 0)
+                {
+                    writer.fail();
+                    loaded.lines.push_back({ nullptr, text });
+                    continue;
+                }
+
+                writer.write(*line);
+                loaded.lines.push_back({ share(std::move(line)), "" });
             }
 
-            StreamInterpreter file_interpreter(include_file);
-            BindingTable new_bindings = file_interpreter.run(&includes);
+            writer.save(cachePath, hash);
+        }
+    }
+
+    if (!eager) return;
+
+    for (const auto& line : loaded.lines)
+    if (auto include = dynamic_cast<const AST::Include*>(line.line.get()))
+        prefetch(include->name);
+}
+
+ModuleLoader::Outline ModuleLoader::outline(const std::string& name)
+{
+    Outline outline;
+    std::ifstream file(name + ".lambda");
+
+    if (file.fail())
+    {
+        const auto& loaded = get(name);
+        outline.found = loaded.found;
+
+        for (const auto& line : loaded.lines)
+        {
+            if (auto binding = dynamic_cast<const AST::Binding*>(line.line.get()))
+                outline.bound.push_back(binding->from.name);
+            if (auto builtin = dynamic_cast<const AST::BuiltinDecl*>(line.line.get()))
+                outline.bound.push_back(builtin->name);
+            if (auto include = dynamic_cast<const AST::Include*>(line.line.get()))
+                outline.includes.push_back(include->name);
+        }
+
+        return outline;
+    }
+
+    outline.found = true;
+
+    // The first two tokens of a line say what it binds or includes, so a line with an `=`
+    // is only lexed up to it. A line that would not parse is found when the module runs.
+    LineReader lines(file);
+    while (!lines.end())
+    {
+        auto text = lines.read();
+        auto equals = text.find('=');
+        auto tokens = tokenize(std::string_view(text).substr(0, equals == std::string::npos ? equals : equals + 1));
+        if (tokens.size() < 3) continue;
+
+        const auto& first = tokens[0];
+        const auto& second = tokens[1];
+
+        if (first.kind == Token::Kind::Name && second.kind == Token::Kind::Equals)
+            outline.bound.push_back(Symbol(std::string(first.text)));
+
+        if (first.kind == Token::Kind::Directive && second.kind == Token::Kind::Name && first.text == "builtin")
+            outline.bound.push_back(Symbol(std::string(second.text)));
+
+        if (first.kind == Token::Kind::Directive && second.kind == Token::Kind::String && first.text == "include")
+            outline.includes.push_back(std::string(second.text));
+    }
+
+    return outline;
+}
+
+std::shared_ptr<const AST::Line> Interpreter::next()
+{
+    auto source = read();
+    std::unique_ptr<AST::Line> line = Parser<AST::Line>::parse(source);
+
+    if (!line || source.length() > 0)
+    {
+        print_error("Unable to parse: \"" + source + "\"");
+        return nullptr;
+    }
+
+    return share(std::move(line));
+}
+
+void Interpreter::bind(Symbol name, const AST::Expression& expression)
+{
+    // Bindings outlive the line they were parsed from, so must not be in the arena
+    Arena::Scope heap(nullptr);
+
+    if (!bindings.contains(name)) order.push_back(name);
+    bindings.bind(name, expression.deepCopy());
+    program.define(name, expression);
+}
+
+void Interpreter::inherit(const Interpreter& base)
+{
+    bindings = base.bindings;
+    order = base.order;
+    includes = base.includes;
+    engine = base.engine;
+    stats = base.stats;
+    pool = base.pool;
+    budget = base.budget;
+    program = base.program;
+    code = base.code;
+    loader = base.loader;
+    lazy = base.lazy;
+    deferred = base.deferred;
+}
+
+void Interpreter::include(const std::string& name, std::uint64_t deferredAt)
+{
+    if (!loader) loader = std::make_shared<ModuleLoader>();
+
+    const auto& module = loader->get(name);
+    if (!module.found)
+    {
+        print_error("Include Error: Failed to open file: \""+name+".lambda\"");
+        return;
+    }
+
+    // Run the module in an interpreter of its own, then take its bindings in order
+    ModuleInterpreter file_interpreter(module);
+    file_interpreter.loader = loader;
+    file_interpreter.engine = engine;
+    file_interpreter.stats = stats;
+    file_interpreter.pool = pool;
+    file_interpreter.budget = budget;
+    file_interpreter.lazy = lazy;
+    file_interpreter.defer = lazy;
+
+    // The times names were bound at are of this interpreter's bindings, not the module's
+    auto bound = std::move(deferred.bound);
+    file_interpreter.deferred = std::move(deferred);
+    file_interpreter.run(nullptr, &includes);
+    deferred = std::move(file_interpreter.deferred);
+    deferred.bound = std::move(bound);
+
+    // A module run eagerly binds as of now, and one that was deferred as of then
+    auto at = deferredAt ? deferredAt : ++deferred.clock;
+
+    for (auto binding : file_interpreter.order)
+    {
+        if (lazy)
+        {
+            auto& boundAt = deferred.bound[binding.id];
+            if (boundAt > at) continue;
+            boundAt = at;
+        }
+
+        if (bindings.contains(binding))
+            print_error(
+                "Include warning: "
+                "Shadowing binding `" + binding.str() +
+                "` while including " + name
+            );
+        
+        bind(binding, *file_interpreter.bindings.at(binding));
+    }
+
+    includes = file_interpreter.includes;
+    includes.insert(name);
+}
+
+/// The namespace of a name, before its first `::`, or the whole name if it has none
+static std::string namespaceOf(Symbol name)
+{
+    const auto& str = name.str();
+    return str.substr(0, str.find("::"));
+}
+
+void Interpreter::deferInclude(const std::string& name)
+{
+    if (!loader) loader = std::make_shared<ModuleLoader>();
+
+    // The module and those it includes run, when they do, as of now
+    auto at = ++deferred.clock;
+
+    std::vector<std::string> pending { name };
+    while (!pending.empty())
+    {
+        auto module = std::move(pending.back());
+        pending.pop_back();
+        if (includes.contains(module)) continue;
+
+        auto outline = loader->outline(module);
+        if (!outline.found)
+        {
+            print_error("Include Error: Failed to open file: \""+module+".lambda\"");
+            continue;
+        }
+
+        includes.insert(module);
+        deferred.modules[module] = at;
+
+        for (auto defined : outline.bound)
+        {
+            auto& modules = deferred.namespaces[namespaceOf(defined)];
+            if (modules.empty() || modules.back() != module) modules.push_back(module);
+        }
 
-            for (const auto& entry : new_bindings)
+        const auto& included = outline.includes;
+
+        // Pushed in reverse, so they are indexed in the order they are included
+        pending.insert(pending.end(), included.rbegin(), included.rend());
+    }
+}
+
+void Interpreter::resolve(const AST::Expression& expression)
+{
+    std::vector<Symbol> names;
+    std::unordered_set<Symbol::Id> seen;
+
+    /// Push the names in an expression, including those it binds, which at worst run a module early
+    auto collect = [&](const AST::Expression& root)
+    {
+        std::vector<AST::Expression::Piece> pieces;
+        std::vector<const AST::Expression*> pending { &root };
+
+        while (!pending.empty())
+        {
+            auto expr = pending.back();
+            pending.pop_back();
+
+            if (auto name = dynamic_cast<const AST::Name*>(expr))
             {
-                if (bindings.contains(entry.first))
-                    print_error(
-                        "Include warning: "
-                        "Shadowing binding `" + entry.first +
-                        "` while including " + include->name
-                    );
-                
-                bindings[entry.first] = entry.second->getExpressionCopy();
+                if (seen.insert(name->name.id).second) names.push_back(name->name);
+                continue;
             }
 
-            includes = file_interpreter.includes;
-            includes.insert(include->name);
+            pieces.clear();
+            expr->pieces(pieces);
+            for (const auto& piece : pieces)
+                if (piece.expr) pending.push_back(piece.expr);
+        }
+    };
+
+    collect(expression);
+
+    while (!names.empty() && !deferred.modules.empty())
+    {
+        auto name = names.back();
+        names.pop_back();
+
+        if (!bindings.contains(name))
+        if (auto it = deferred.namespaces.find(namespaceOf(name)); it != deferred.namespaces.end())
+        {
+            auto modules = std::move(it->second);
+            deferred.namespaces.erase(it);
+
+            for (const auto& module : modules)
+            if (auto found = deferred.modules.find(module); found != deferred.modules.end())
+            {
+                auto at = found->second;
+                deferred.modules.erase(found);
+                include(module, at);
+            }
         }
+
+        // Held, as running a module may replace the binding
+        if (auto bound = bindings.at(name)) collect(*bound);
     }
+}
 
-    return bindings;
+AST::ExpressionPtr Interpreter::evaluate(const AST::Expression& expression)
+{
+    switch (engine)
+    {
+    case Engine::Graph:
+        return Graph::Evaluator(program).evaluate(expression);
+
+    case Engine::Machine:
+        return Machine::Evaluator(program).evaluate(expression, budget);
+
+    case Engine::Bytecode:
+        return Bytecode::VM(program, code).evaluate(expression);
+
+    case Engine::Substitution:
+    default:
+    {
+        Parallel::Pool::Scope scope(pool.get(), bindings);
+        return expression.simplify(bindings);
+    }
+    }
 }
 
 std::string StreamInterpreter::read()
@@ -119,6 +564,25 @@ void StreamInterpreter::print_error(std::string message)
 bool StreamInterpreter::end()
 { return input.eof(); }
 
+std::shared_ptr<const AST::Line> ModuleInterpreter::next()
+{
+    const auto& line = module.lines[position++];
+    if (!line.line) print_error("Unable to parse: \"" + line.source + "\"");
+    return line.line;
+}
+
+std::string ModuleInterpreter::read()
+{ return ""; }
+
+void ModuleInterpreter::print(std::string message)
+{ output << message << std::endl; }
+
+void ModuleInterpreter::print_error(std::string message)
+{ error << message << std::endl; }
+
+bool ModuleInterpreter::end()
+{ return position == module.lines.size(); }
+
 std::string Repl::read()
 {
     output << ">>> " << std::flush;
@@ -138,4 +602,100 @@ void Repl::print_error(std::string message)
     output << "\n";
 }
 
-}
\ No newline at end of file
+/// Evaluates the lines of a batch, with its own copy of the bindings, the IR and the bytecode
+class BatchWorker : public Interpreter
+{
+public:
+    /// The output of a line, which is empty for a comment
+    struct Output
+    {
+        std::string text;
+        bool error = false;
+    };
+
+    BatchWorker(const Interpreter& loaded)
+    { inherit(loaded); }
+
+    Output evaluateLine(std::string source)
+    {
+        arena.reset();
+        Arena::Scope scope(&arena);
+
+        std::unique_ptr<AST::Line> line = Parser<AST::Line>::parse(source);
+        if (!line || source.length() > 0)
+            return { "Unable to parse: \"" + source + "\"", true };
+
+        if (dynamic_cast<const AST::Comment*>(line.get())) return {};
+
+        // Anything else would change the bindings the other workers are reading
+        AST::ExpressionPtr expression = dynamic_pointer_cast<AST::Expression>(std::move(line));
+        if (!expression)
+            return { "Batch Error: Only expressions can be evaluated in a batch", true };
+
+        try
+        {
+            return { evaluate(*expression)->toString() };
+        } catch (const evaluation_error& e)
+        {
+            return { "Evaluation error: " + std::string(e.what()), true };
+        }
+    }
+
+protected:
+    std::string read() override { return ""; }
+    void print(std::string) override {}
+    void print_error(std::string) override {}
+    bool end() override { return true; }
+};
+
+void Batch::run(std::istream& input, std::ostream& output, std::ostream& error)
+{
+    std::vector<std::string> lines;
+    LineReader reader(input);
+    while (!reader.end()) lines.push_back(reader.read());
+
+    std::vector<BatchWorker::Output> outputs(lines.size());
+    std::vector<bool> done(lines.size());
+    std::mutex mutex;
+    std::condition_variable finished;
+
+    // Each worker takes the next line no worker has, so none is idle while lines remain
+    std::atomic<std::size_t> next = 0;
+
+    auto work = [&]()
+    {
+        BatchWorker worker(loaded);
+
+        for (std::size_t i; (i = next++) < lines.size();)
+        {
+            auto result = worker.evaluateLine(std::move(lines[i]));
+            {
+                std::lock_guard lock(mutex);
+                outputs[i] = std::move(result);
+                done[i] = true;
+            }
+            finished.notify_all();
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (unsigned i = 0; i < std::min<std::size_t>(threads, lines.size()); i++)
+        workers.emplace_back(work);
+
+    for (std::size_t i = 0; i < lines.size(); i++)
+    {
+        BatchWorker::Output result;
+        {
+            std::unique_lock lock(mutex);
+            finished.wait(lock, [&]() { return done[i]; });
+            result = std::move(outputs[i]);
+        }
+
+        if (result.text.empty()) continue;
+        (result.error ? error : output) << result.text << std::endl;
+    }
+
+    for (auto& worker : workers) worker.join();
+}
+
+}
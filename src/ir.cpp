@@ -0,0 +1,600 @@
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "headers/ir.hpp"
+#include "headers/arena.hpp"
+#include "headers/util.hpp"
+#include "headers/ast.hpp"
+
+namespace LambdaCalc::IR
+{
+
+Slot Program::slot(Symbol name)
+{
+    if (name.id >= slots.size()) slots.resize(name.id + 1, none);
+    if (slots[name.id] != none) return slots[name.id];
+
+    Slot slot = globals.size();
+    globals.push_back({ name });
+    slots[name.id] = slot;
+    return slot;
+}
+
+Program::Scratch::Scratch(Program& program) : program(program)
+{
+    if (program.scratches++ > 0) return;
+
+    // Recognising numerals adds nodes, which must outlast the scratch
+    program.recognise();
+    program.scratchNodes = program.nodes.size();
+    program.scratchStrings = program.strings.size();
+}
+
+Program::Scratch::~Scratch()
+{
+    if (--program.scratches > 0) return;
+
+    program.nodes.resize(program.scratchNodes);
+    for (auto id = program.scratchStrings; id < program.strings.size(); id++)
+        program.stringIds.erase(program.strings[id]);
+    program.strings.resize(program.scratchStrings);
+}
+
+void Program::define(Symbol name, const AST::Expression& expr)
+{
+    if (scratches > 0)
+        throw std::logic_error("Cannot define `" + name.str() + "` while expressions are lowered into scratch");
+
+    Index root = lower(expr);
+    globals[slot(name)].root = root;
+    recognised = false;
+}
+
+void Program::recognise()
+{
+    if (recognised) return;
+    numerals.recognise(*this);
+    recognised = true;
+}
+
+std::uint32_t Program::string(const std::string& str)
+{
+    if (auto it = stringIds.find(str); it != stringIds.end())
+        return it->second;
+
+    std::uint32_t id = strings.size();
+    strings.push_back(str);
+    stringIds[str] = id;
+    return id;
+}
+
+Index Program::push(Node node)
+{
+    nodes.push_back(node);
+    return nodes.size() - 1;
+}
+
+Index Program::lower(const AST::Expression& expr)
+{
+    std::vector<Symbol> scope;
+    return lower(expr, scope);
+}
+
+Index Program::lower(const AST::Expression& expr, std::vector<Symbol>& scope)
+{
+    if (auto name = dynamic_cast<const AST::Name*>(&expr))
+    {
+        for (std::size_t i = scope.size(); i-- > 0;)
+            if (scope[i] == name->name)
+                return push({ Node::Kind::Variable, std::uint32_t(scope.size() - 1 - i) });
+
+        return push({ Node::Kind::Global, slot(name->name) });
+    }
+
+    if (auto str = dynamic_cast<const AST::String*>(&expr))
+        return push({ Node::Kind::String, string(str->str.flatten()) });
+
+    if (auto bracket = dynamic_cast<const AST::BracketExpr*>(&expr))
+        return lower(*bracket->expr, scope);
+
+    if (auto application = dynamic_cast<const AST::ApplicationExpr*>(&expr))
+    {
+        Index left = lower(*application->left, scope);
+        Index right = lower(*application->right, scope);
+        return push({ Node::Kind::Application, 0, left, right });
+    }
+
+    if (auto mapping = dynamic_cast<const AST::Mapping*>(&expr))
+    {
+        auto name = mapping->from.name;
+
+        scope.push_back(name);
+        Index body = lower(*mapping->to, scope);
+        scope.pop_back();
+
+        return push({ Node::Kind::Lambda, name.id, body });
+    }
+
+    if (auto let = dynamic_cast<const AST::LetExpr*>(&expr))
+    {
+        auto name = let->binding->from.name;
+        Index value = lower(*let->binding->to, scope);
+
+        scope.push_back(name);
+        Index body = lower(*let->expr, scope);
+        scope.pop_back();
+
+        return push({ Node::Kind::StrictLet, name.id, value, body });
+    }
+
+    if (auto where = dynamic_cast<const AST::WhereExpr*>(&expr))
+        return lowerWhere(*where, scope);
+
+    if (auto builtin = dynamic_cast<const AST::Builtin*>(&expr))
+        return lowerBuiltin(*builtin, scope);
+
+    throw std::logic_error("Cannot lower expression: " + expr.toString());
+}
+
+/// The bindings are placed inside the mappings at the head of the qualified expression,
+/// stopping at any mapping that shadows one of them, as substitution would.
+Index Program::lowerWhere(const AST::WhereExpr& where, std::vector<Symbol>& scope)
+{
+    // Outermost binding first, each binding can see those listed after it
+    std::vector<const AST::Binding*> bindings;
+    const AST::Expression* core = &where;
+    while (auto whereExpr = dynamic_cast<const AST::WhereExpr*>(core))
+    {
+        bindings.push_back(whereExpr->binding.get());
+        core = whereExpr->expr.get();
+    }
+
+    std::vector<Symbol> params;
+    while (true)
+    {
+        if (auto bracket = dynamic_cast<const AST::BracketExpr*>(core))
+            core = bracket->expr.get();
+        else if (auto mapping = dynamic_cast<const AST::Mapping*>(core))
+        {
+            bool shadows = false;
+            for (const auto& binding : bindings)
+                shadows |= binding->from.name == mapping->from.name;
+            if (shadows) break;
+
+            params.push_back(mapping->from.name);
+            core = mapping->to.get();
+        }
+        else break;
+    }
+
+    const auto depth = scope.size();
+    for (const auto& param : params) scope.push_back(param);
+
+    std::vector<Index> values;
+    std::vector<Symbol> names;
+    for (const auto& binding : bindings)
+    {
+        values.push_back(lower(*binding->to, scope));
+        names.push_back(binding->from.name);
+        scope.push_back(names.back());
+    }
+
+    Index index = lower(*core, scope);
+
+    for (auto i = bindings.size(); i-- > 0;)
+        index = push({ Node::Kind::Let, names[i].id, values[i], index });
+
+    for (auto i = params.size(); i-- > 0;)
+        index = push({ Node::Kind::Lambda, params[i].id, index });
+
+    scope.resize(depth);
+    return index;
+}
+
+/// A primitive is a lambda of each of its parameters, around a node that runs it on them.
+/// The arguments it has already been given are applied to that.
+Index Program::lowerBuiltin(const AST::Builtin& builtin, std::vector<Symbol>& scope)
+{
+    const auto& primitive = *builtin.primitive;
+    Node node { Node::Kind::Builtin, primitive.id };
+
+    if (primitive.result == Builtins::Type::Bool)
+    {
+        const static Symbol a("a"), b("b");
+        node.left = push({ Node::Kind::Lambda, a.id, push({ Node::Kind::Lambda, b.id, push({ Node::Kind::Variable, 1 }) }) });
+        node.right = push({ Node::Kind::Lambda, a.id, push({ Node::Kind::Lambda, b.id, push({ Node::Kind::Variable, 0 }) }) });
+    }
+
+    Index index = push(node);
+    for (auto i = primitive.arity(); i-- > 0;)
+        index = push({ Node::Kind::Lambda, Symbol(std::string(1, char('a' + i))).id, index });
+
+    for (const auto& arg : builtin.args)
+    {
+        Index right = lower(*arg, scope);
+        index = push({ Node::Kind::Application, 0, index, right });
+    }
+
+    return index;
+}
+
+void Reader::push(Item item, std::size_t arity)
+{
+    item.first = children.size();
+    children.insert(children.end(), results.end() - arity, results.end());
+    results.resize(results.size() - arity);
+
+    results.push_back(items.size());
+    items.push_back(std::move(item));
+}
+
+void Reader::expression(AST::ExpressionPtr expr)
+{
+    Item item { Item::Kind::Expression };
+    item.expr = std::move(expr);
+    push(std::move(item));
+}
+
+void Reader::name(Symbol name)
+{
+    Item item { Item::Kind::Name };
+    item.name = name;
+    push(std::move(item));
+}
+
+void Reader::term(Index root, Handle env)
+{ tasks.push_back({ Task::Kind::Node, env, root, 0, bound.size() }); }
+
+void Reader::application(Handle left, Handle right)
+{
+    tasks.push_back({ Task::Kind::Apply, 0 });
+    tasks.push_back({ Task::Kind::Value, right });
+    tasks.push_back({ Task::Kind::Value, left });
+}
+
+void Reader::alias(Handle value)
+{ tasks.push_back({ Task::Kind::Value, value }); }
+
+void Reader::resolve(const Task& task, std::uint32_t index)
+{
+    auto local = bound.size() - task.base;
+    if (index >= local)
+    {
+        tasks.push_back({ Task::Kind::Value, variable(task.handle, index - local) });
+        return;
+    }
+
+    const auto& var = bound[bound.size() - 1 - index];
+    if (var.binder == none)
+    {
+        results.push_back(var.value);
+        return;
+    }
+
+    Item item { Item::Kind::Variable };
+    item.binder = var.binder;
+    push(std::move(item));
+}
+
+AST::ExpressionPtr Reader::read(Handle value)
+{
+    items.clear();
+    children.clear();
+    binders.clear();
+
+    tasks.push_back({ Task::Kind::Value, value });
+
+    while (!tasks.empty())
+    {
+        auto task = tasks.back();
+        tasks.pop_back();
+
+        switch (task.kind)
+        {
+        case Task::Kind::Value:
+            visit(task.handle);
+            break;
+
+        case Task::Kind::Apply:
+            push({ Item::Kind::Apply }, 2);
+            break;
+
+        case Task::Kind::Node:
+            raise(task);
+            break;
+        }
+    }
+
+    auto root = results.back();
+    results.pop_back();
+
+    rename(root);
+    return build(root);
+}
+
+void Reader::raise(const Task& task)
+{
+    const Node& node = program.nodes[task.index];
+
+    auto again = [&](int visit)
+    {
+        auto next = task;
+        next.visit = visit;
+        tasks.push_back(next);
+    };
+
+    auto child = [&](Index index)
+    {
+        auto next = task;
+        next.index = index;
+        next.visit = 0;
+        tasks.push_back(next);
+    };
+
+    auto binder = [&]()
+    {
+        binders.push_back({ Symbol::fromId(node.value) });
+        return std::uint32_t(binders.size() - 1);
+    };
+
+    switch (node.kind)
+    {
+    case Node::Kind::Variable:
+        resolve(task, node.value);
+        break;
+
+    case Node::Kind::Builtin:
+    {
+        // Each argument is read back before the next is looked up, as reading it may push tasks
+        const auto& primitive = Builtins::get(node.value);
+        if (task.visit < int(primitive.arity()))
+        {
+            again(task.visit + 1);
+            resolve(task, primitive.arity() - 1 - task.visit);
+            break;
+        }
+
+        Item item { Item::Kind::Builtin };
+        item.primitive = &primitive;
+        push(std::move(item), primitive.arity());
+        break;
+    }
+
+    case Node::Kind::Global:
+        name(program.globals[node.value].name);
+        break;
+
+    case Node::Kind::String:
+        expression(make_arena_shared<AST::String>(program.strings[node.value]));
+        break;
+
+    case Node::Kind::Lambda:
+        if (task.visit == 0)
+        {
+            bound.push_back({ binder(), 0 });
+            again(1);
+            child(node.left);
+            break;
+        }
+
+        {
+            Item item { Item::Kind::Lambda };
+            item.binder = bound.back().binder;
+            bound.pop_back();
+            push(std::move(item), 1);
+        }
+        break;
+
+    case Node::Kind::Application:
+        if (task.visit == 0)
+        {
+            again(1);
+            child(node.right);
+            child(node.left);
+            break;
+        }
+
+        push({ Item::Kind::Apply }, 2);
+        break;
+
+    case Node::Kind::Let:
+    case Node::Kind::StrictLet:
+        if (task.visit == 0)
+        {
+            again(1);
+            child(node.left);
+            break;
+        }
+
+        if (task.visit == 1)
+        {
+            // Where bindings raise as if they had been substituted
+            if (node.kind == Node::Kind::Let)
+            {
+                bound.push_back({ none, results.back() });
+                results.pop_back();
+            }
+            else bound.push_back({ binder(), 0 });
+
+            again(2);
+            child(node.right);
+            break;
+        }
+
+        if (node.kind == Node::Kind::StrictLet)
+        {
+            Item item { Item::Kind::Let };
+            item.binder = bound.back().binder;
+            push(std::move(item), 2);
+        }
+        bound.pop_back();
+        break;
+
+    default:
+        throw std::logic_error("Unknown IR node kind");
+    }
+}
+
+void Reader::rename(std::uint32_t root)
+{
+    /// An item to walk, or the binder of one to bring into or out of scope
+    struct Visit
+    {
+        std::uint32_t item;
+        enum class Kind { Walk, Enter, Leave } kind = Kind::Walk;
+    };
+
+    // The binders in scope with each name, innermost last
+    std::unordered_map<Symbol::Id, std::vector<std::uint32_t>> scopes;
+
+    // Every name that appears in the expression, so that new names differ from them
+    std::unordered_set<Symbol::Id> used;
+
+    // A name used where binders with the same name are in scope is captured by each of them
+    // inside target, the binder it refers to, if any
+    auto capture = [&](Symbol name, std::uint32_t target)
+    {
+        const auto& scope = scopes[name.id];
+        for (auto i = scope.size(); i-- > 0 && scope[i] != target;)
+            binders[scope[i]].renamed = true;
+    };
+
+    std::vector<Visit> visits { { root } };
+    while (!visits.empty())
+    {
+        auto visit = visits.back();
+        visits.pop_back();
+
+        const auto& item = items[visit.item];
+        const auto* child = children.data() + item.first;
+
+        if (visit.kind == Visit::Kind::Enter)
+        {
+            scopes[binders[item.binder].name.id].push_back(item.binder);
+            continue;
+        }
+
+        if (visit.kind == Visit::Kind::Leave)
+        {
+            scopes[binders[item.binder].name.id].pop_back();
+            continue;
+        }
+
+        switch (item.kind)
+        {
+        case Item::Kind::Expression:
+            break;
+
+        case Item::Kind::Name:
+            used.insert(item.name.id);
+            capture(item.name, none);
+            break;
+
+        case Item::Kind::Variable:
+            capture(binders[item.binder].name, item.binder);
+            break;
+
+        case Item::Kind::Lambda:
+            used.insert(binders[item.binder].name.id);
+            visits.push_back({ visit.item, Visit::Kind::Leave });
+            visits.push_back({ child[0] });
+            visits.push_back({ visit.item, Visit::Kind::Enter });
+            break;
+
+        case Item::Kind::Let:
+            used.insert(binders[item.binder].name.id);
+            visits.push_back({ visit.item, Visit::Kind::Leave });
+            visits.push_back({ child[1] });
+            visits.push_back({ visit.item, Visit::Kind::Enter });
+            visits.push_back({ child[0] });
+            break;
+
+        case Item::Kind::Apply:
+            visits.push_back({ child[1] });
+            visits.push_back({ child[0] });
+            break;
+
+        case Item::Kind::Builtin:
+            for (auto i = item.primitive->arity(); i-- > 0;) visits.push_back({ child[i] });
+            break;
+        }
+    }
+
+    for (auto& binder : binders)
+    {
+        if (!binder.renamed) continue;
+
+        // Numbered rather than primed, so that the result still parses
+        Symbol name;
+        for (std::size_t n = 1; used.count((name = Symbol(binder.name.str() + std::to_string(n))).id); n++);
+
+        binder.name = name;
+        used.insert(binder.name.id);
+    }
+}
+
+AST::ExpressionPtr Reader::build(std::uint32_t root)
+{
+    // Children precede their parents, so each item is built once its children are
+    std::vector<AST::ExpressionPtr> built(root + 1);
+
+    for (std::uint32_t index = 0; index <= root; index++)
+    {
+        const auto& item = items[index];
+        const auto* child = children.data() + item.first;
+
+        switch (item.kind)
+        {
+        case Item::Kind::Expression:
+            built[index] = item.expr;
+            break;
+
+        case Item::Kind::Name:
+            built[index] = make_arena_shared<AST::Name>(item.name);
+            break;
+
+        case Item::Kind::Variable:
+            built[index] = make_arena_shared<AST::Name>(binders[item.binder].name);
+            break;
+
+        case Item::Kind::Apply:
+            built[index] = make_arena_shared<AST::ApplicationExpr>(
+                built[child[0]],
+                AST::SimpleExpr::wrap(built[child[1]])
+            );
+            break;
+
+        case Item::Kind::Lambda:
+            built[index] = make_arena_shared<AST::Mapping>(
+                AST::Name(binders[item.binder].name),
+                built[child[0]]
+            );
+            break;
+
+        case Item::Kind::Let:
+            built[index] = make_arena_shared<AST::LetExpr>(
+                make_arena_shared<AST::Binding>(AST::Name(binders[item.binder].name), built[child[0]]),
+                built[child[1]]
+            );
+            break;
+
+        case Item::Kind::Builtin:
+        {
+            std::vector<std::shared_ptr<const AST::SimpleExpr>> args;
+            for (std::size_t i = 0; i < item.primitive->arity(); i++)
+                args.push_back(AST::SimpleExpr::wrap(built[child[i]]));
+
+            built[index] = make_arena_shared<AST::Builtin>(item.primitive, std::move(args));
+            break;
+        }
+        }
+    }
+
+    return built[root];
+}
+
+}
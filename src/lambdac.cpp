@@ -0,0 +1,83 @@
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "headers/compiler.hpp"
+
+int main(const int argc, const char** const argv)
+{
+    using namespace LambdaCalc;
+
+    // Parse command line arguments
+
+    std::string output;
+    std::vector<std::string> modules;
+    bool embedding = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string s(argv[i]);
+        if ((s == "-o" || s == "--output") && i + 1 < argc) output = argv[++i];
+        else if (s == "--embed") embedding = true;
+        else modules.push_back(s);
+    }
+
+    if (modules.empty())
+    {
+        std::cerr << "Usage: lambdac [--embed] [-o output.cpp] module..." << std::endl;
+        return 1;
+    }
+
+    // Embed the parsed modules for the interpreter, rather than compiling a program
+    if (embedding)
+    {
+        std::ostringstream source;
+        try
+        {
+            embed(source, modules);
+        } catch (const compile_error& e)
+        {
+            std::cerr << "Compile error: " << e.what() << std::endl;
+            return 1;
+        }
+
+        if (output.empty())
+        {
+            std::cout << source.str();
+            return 0;
+        }
+
+        std::ofstream file(output);
+        file << source.str();
+        return file.fail() ? 1 : 0;
+    }
+
+    // Compile the modules, then Main, as bin/main -r would run them
+    Compiler compiler;
+    try
+    {
+        for (const auto& module : modules)
+        if (!compiler.includes.contains(module))
+        {
+            compiler.includes.insert(module);
+            compiler.include(module);
+        }
+
+        compiler.evaluate(AST::Name(Symbol("Main")));
+    } catch (const compile_error& e)
+    {
+        std::cerr << "Compile error: " << e.what() << std::endl;
+        return 1;
+    }
+
+    if (output.empty())
+    {
+        compiler.emit(std::cout);
+        return 0;
+    }
+
+    std::ofstream file(output);
+    compiler.emit(file);
+    return file.fail() ? 1 : 0;
+}
@@ -0,0 +1,187 @@
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "headers/lexer.hpp"
+
+namespace LambdaCalc
+{
+
+namespace
+{
+
+enum Class : std::uint8_t
+{
+    Whitespace = 1 << 0,    ///< " \t\r\n\v"
+    NameChar = 1 << 1       ///< Letters, digits, `_` and `:`
+};
+
+constexpr std::array<std::uint8_t, 256> makeClasses()
+{
+    std::array<std::uint8_t, 256> classes = {};
+
+    for (unsigned char c : std::string_view(" \t\r\n\v")) classes[c] |= Whitespace;
+
+    for (int c = 'A'; c <= 'Z'; c++) classes[c] |= NameChar;
+    for (int c = 'a'; c <= 'z'; c++) classes[c] |= NameChar;
+    for (int c = '0'; c <= '9'; c++) classes[c] |= NameChar;
+    classes['_'] |= NameChar;
+    classes[':'] |= NameChar;
+
+    return classes;
+}
+
+/// The classes of each character, looked up by its byte
+constexpr auto classes = makeClasses();
+
+bool is(char c, Class cls)
+{ return classes[static_cast<unsigned char>(c)] & cls; }
+
+#ifdef __SSE2__
+
+/// A bit for each of 16 bytes that is in the range [lo, hi]. Bytes above 0x7f
+/// compare as negative, so are never in a range of ASCII characters.
+__m128i inRange(__m128i chunk, char lo, char hi)
+{
+    return _mm_and_si128(
+        _mm_cmpgt_epi8(chunk, _mm_set1_epi8(lo - 1)),
+        _mm_cmplt_epi8(chunk, _mm_set1_epi8(hi + 1))
+    );
+}
+
+/// A bit for each of 16 bytes that is in a class
+unsigned matches(__m128i chunk, Class cls)
+{
+    auto equal = [&](char c) { return _mm_cmpeq_epi8(chunk, _mm_set1_epi8(c)); };
+
+    __m128i found;
+    if (cls == Whitespace)
+        found = _mm_or_si128(
+            _mm_or_si128(equal(' '), equal('\t')),
+            _mm_or_si128(_mm_or_si128(equal('\r'), equal('\n')), equal('\v'))
+        );
+    else
+        found = _mm_or_si128(
+            _mm_or_si128(inRange(chunk, 'A', 'Z'), inRange(chunk, 'a', 'z')),
+            _mm_or_si128(inRange(chunk, '0', '9'), _mm_or_si128(equal('_'), equal(':')))
+        );
+
+    return unsigned(_mm_movemask_epi8(found));
+}
+
+#endif
+
+/// @return The first character from p that is not in a class, 16 at a time where possible
+const char* skip(const char* p, const char* end, Class cls)
+{
+#ifdef __SSE2__
+    while (end - p >= 16)
+    {
+        unsigned mask = matches(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)), cls);
+        if (mask != 0xffff) return p + std::countr_zero(~mask);
+        p += 16;
+    }
+#endif
+
+    while (p < end && is(*p, cls)) p++;
+    return p;
+}
+
+/// @return The first occurrence of c from p, or end if there is none
+const char* find(const char* p, const char* end, char c)
+{
+    // memchr is vectorised by the C library
+    auto found = static_cast<const char*>(std::memchr(p, c, end - p));
+    return found ? found : end;
+}
+
+}
+
+std::vector<Token> tokenize(std::string_view source)
+{
+    std::vector<Token> tokens;
+
+    const char* p = source.data();
+    const char* end = p + source.size();
+
+    auto push = [&](Token::Kind kind, const char* begin, const char* finish)
+    { tokens.push_back({ kind, std::string_view(begin, finish - begin) }); };
+
+    while (true)
+    {
+        p = skip(p, end, Whitespace);
+        if (p == end) break;
+
+        const char* begin = p;
+
+        if (is(*p, NameChar))
+        {
+            p = skip(p, end, NameChar);
+            push(Token::Kind::Name, begin, p);
+            continue;
+        }
+
+        switch (*p)
+        {
+        case '"':
+        {
+            const char* close = find(p + 1, end, '"');
+            if (close == end)
+            {
+                push(Token::Kind::Invalid, begin, end);
+                p = end;
+                break;
+            }
+
+            push(Token::Kind::String, p + 1, close);
+            p = close + 1;
+            continue;
+        }
+
+        case '#':
+            p = skip(p + 1, end, NameChar);
+            push(Token::Kind::Directive, begin + 1, p);
+            continue;
+
+        case '/':
+            if (end - p >= 2 && p[1] == '/')
+            {
+                p = find(p, end, '\n');
+                push(Token::Kind::Comment, begin, p);
+                continue;
+            }
+            break;
+
+        case '-':
+            if (end - p >= 2 && p[1] == '>')
+            {
+                p += 2;
+                push(Token::Kind::Arrow, begin, p);
+                continue;
+            }
+            break;
+
+        case '=': push(Token::Kind::Equals, p, p + 1); p++; continue;
+        case ',': push(Token::Kind::Comma, p, p + 1); p++; continue;
+        case '$': push(Token::Kind::Dollar, p, p + 1); p++; continue;
+        case '(': push(Token::Kind::Open, p, p + 1); p++; continue;
+        case ')': push(Token::Kind::Close, p, p + 1); p++; continue;
+        }
+
+        // Nothing can be parsed from here on
+        if (p != end) push(Token::Kind::Invalid, p, p + 1);
+        break;
+    }
+
+    push(Token::Kind::End, end, end);
+    return tokens;
+}
+
+}
@@ -0,0 +1,768 @@
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "headers/machine.hpp"
+#include "headers/arena.hpp"
+#include "headers/builtin.hpp"
+#include "headers/evaluator.hpp"
+#include "headers/ir.hpp"
+#include "headers/ast.hpp"
+
+namespace LambdaCalc::Machine
+{
+
+using IR::Index;
+
+Environment::~Environment()
+{
+    release(std::move(thunk));
+    release(std::move(next));
+}
+
+Value::~Value()
+{
+    release(std::move(env));
+    release(std::move(base));
+}
+
+Thunk::~Thunk()
+{
+    release(std::move(env));
+    release(std::move(value));
+    release(std::move(alias));
+}
+
+const ThunkPtr& lookup(const EnvironmentPtr& env, std::uint32_t index)
+{
+    auto frame = env.get();
+    for (; index > 0; index--) frame = frame->next.get();
+    return frame->thunk;
+}
+
+namespace
+{
+
+using Op = IR::Numerals::Op;
+
+/// A numeral seen as a count of successors of a base, which is null for zero
+struct Layer
+{
+    std::uint64_t count;
+    ThunkPtr base;
+};
+
+/// The value of a thunk, or null if it has not been evaluated
+const ValuePtr& evaluated(const ThunkPtr& thunk)
+{
+    if (thunk->alias && thunk->alias->value)
+    {
+        thunk->value = thunk->alias->value;
+        thunk->alias = nullptr;
+    }
+
+    return thunk->value;
+}
+
+/// The numeral a value is, if it is a number or a closure of zero or a successor
+std::optional<Layer> numeral(const IR::Numerals& numerals, const Value& value)
+{
+    if (value.kind == Value::Kind::Number) return Layer{ value.number, value.base };
+
+    if (value.kind == Value::Kind::Closure)
+    {
+        auto op = numerals.op(value.lambda);
+        if (op == Op::Zero) return Layer{ 0, nullptr };
+        if (op == Op::Successor) return Layer{ 1, value.env->thunk };
+    }
+
+    return std::nullopt;
+}
+
+/// The numeral a thunk is, if it and all of its bases have already been evaluated
+std::optional<std::uint64_t> known(const IR::Numerals& numerals, ThunkPtr thunk)
+{
+    std::uint64_t count = 0;
+    while (thunk)
+    {
+        const auto& value = evaluated(thunk);
+        if (!value) return std::nullopt;
+
+        auto layer = numeral(numerals, *value);
+        if (!layer) return std::nullopt;
+
+        count += layer->count;
+        thunk = layer->base;
+    }
+
+    return count;
+}
+
+ValuePtr number(std::uint64_t count, ThunkPtr base)
+{ return make_arena_shared<Value>(count, std::move(base)); }
+
+/// A thunk of count successors of base
+ThunkPtr successors(std::uint64_t count, ThunkPtr base)
+{
+    if (count == 0 && base) return base;
+    return make_arena_shared<Thunk>(number(count, std::move(base)));
+}
+
+}
+
+ValuePtr expand(const IR::Program& program, const Value& number)
+{
+    const auto& numerals = program.numerals;
+    if (number.number == 0) return make_arena_shared<Value>(numerals.zero, nullptr);
+
+    return make_arena_shared<Value>(numerals.incr, make_arena_shared<Environment>(
+        successors(number.number - 1, number.base), nullptr
+    ));
+}
+
+AST::ExpressionPtr Evaluator::evaluate(const AST::Expression& expr, const Async::Budget& budget)
+{
+    IR::Program::Scratch scratch(program);
+    auto task = start(expr, budget);
+    while (!task.resume());
+
+    return readBack(program, task.result());
+}
+
+Async::Task<ValuePtr> Evaluator::start(const AST::Expression& expr, Async::Budget budget)
+{
+    program.recognise();
+    Index root = program.lower(expr);
+    globals.resize(program.globals.size());
+
+    taken = 0;
+    return run(root, budget);
+}
+
+const ThunkPtr& Core::global(IR::Slot slot)
+{
+    if (globals[slot]) return globals[slot];
+
+    const auto& global = program.globals[slot];
+    if (global.root == IR::none)
+        throw evaluation_error("Cannot evaluate `"+global.name.str()+"`, it is not defined.");
+
+    return globals[slot] = make_arena_shared<Thunk>(global.root, nullptr);
+}
+
+void Core::enter(ThunkPtr thunk)
+{
+    if (thunk->alias && thunk->alias->value)
+    {
+        thunk->value = thunk->alias->value;
+        thunk->alias = nullptr;
+    }
+
+    if (thunk->value)
+    {
+        value = thunk->value;
+        return;
+    }
+
+    if (thunk->entered)
+        throw evaluation_error("Infinite loop while evaluating " + readBack(program, thunk)->toString());
+
+    thunk->entered = true;
+    term = thunk->term;
+    env = thunk->env;
+
+    // The value of a thunk entered with an update frame on top of the stack is
+    // the value of the thunk being updated, so share that rather than push a frame
+    if (!stack.empty() && stack.back().kind == Frame::Kind::Update)
+    {
+        thunk->alias = stack.back().thunk;
+        thunk->env = nullptr;
+    }
+    else stack.push_back({ Frame::Kind::Update, std::move(thunk) });
+}
+
+void Core::sequence(ThunkPtr thunk, Index body)
+{
+    stack.push_back({
+        Frame::Kind::Sequence, nullptr, nullptr, body,
+        make_arena_shared<Environment>(thunk, env)
+    });
+    enter(std::move(thunk));
+}
+
+bool Core::pass()
+{
+    if (stack.empty()) return false;
+
+    auto frame = std::move(stack.back());
+    stack.pop_back();
+
+    switch (frame.kind)
+    {
+    case Frame::Kind::Argument:
+        // A number applied to anything but a numeral operation is its Church numeral
+        if (value->kind == Value::Kind::Number)
+            value = expand(program, *value);
+
+        if (value->kind == Value::Kind::Closure)
+        {
+            Index lambda = value->lambda;
+            term = program.nodes[lambda].left;
+            env = make_arena_shared<Environment>(frame.thunk, value->env);
+            value = nullptr;
+            operate(lambda);
+            break;
+        }
+
+        stack.push_back({ Frame::Kind::Concat, frame.thunk, std::move(value) });
+        value = nullptr;
+        enter(frame.thunk);
+        break;
+
+    case Frame::Kind::Update:
+        frame.thunk->value = value;
+        frame.thunk->env = nullptr;
+        break;
+
+    case Frame::Kind::Concat:
+        if (value->kind != Value::Kind::String)
+            throw evaluation_error(
+                "Left side of application expression must not be a string "
+                "unless right side is also a string in " + readBack(program, frame.value)->toString() +
+                " " + AST::SimpleExpr::wrap(readBack(program, frame.thunk))->toString() +
+                " where Left side is "+ readBack(program, frame.value)->toString() +
+                ", and Right side is " + readBack(program, value)->toString());
+
+        value = make_arena_shared<Value>(frame.value->str + value->str);
+        break;
+
+    case Frame::Kind::Sequence:
+        term = frame.term;
+        env = std::move(frame.env);
+        value = nullptr;
+        break;
+
+    case Frame::Kind::Native:
+        env = std::move(frame.env);
+        value = nullptr;
+
+        if (program.nodes[frame.term].kind == IR::Node::Kind::Builtin)
+        {
+            term = frame.term;
+            primitive(term);
+            break;
+        }
+
+        term = program.nodes[frame.term].left;
+        operate(frame.term);
+        break;
+    }
+
+    return true;
+}
+
+bool Core::operate(Index lambda)
+{
+    const auto& numerals = program.numerals;
+
+    /// A thunk applying a numeral operation's global to its arguments
+    auto call = [&](Op op, ThunkPtr a, ThunkPtr b = nullptr)
+    {
+        auto args = make_arena_shared<Environment>(std::move(a), nullptr);
+        if (b) args = make_arena_shared<Environment>(std::move(b), std::move(args));
+        return make_arena_shared<Thunk>(numerals.call(op), std::move(args));
+    };
+
+    enum class Status { Known, Forcing, Other };
+
+    const auto op = numerals.op(lambda);
+    if (op == Op::None || op == Op::Zero || op == Op::Successor) return false;
+
+    const bool binary = op == Op::Add || op == Op::Mult || op == Op::Sub;
+    ThunkPtr b = env->thunk;
+    ThunkPtr a = binary ? env->next->thunk : nullptr;
+
+    /// Evaluate a thunk, then run the operation again
+    auto force = [&](ThunkPtr thunk)
+    {
+        stack.push_back({ Frame::Kind::Native, nullptr, nullptr, lambda, env });
+        enter(std::move(thunk));
+        return Status::Forcing;
+    };
+
+    /// The outermost successor of a numeral, skipping any zero counts
+    auto layer = [&](ThunkPtr& thunk, Layer& out)
+    {
+        while (true)
+        {
+            const auto& current = evaluated(thunk);
+            if (!current) return force(thunk);
+
+            auto found = numeral(numerals, *current);
+            if (!found) return Status::Other;
+
+            if (found->count == 0 && found->base)
+            {
+                thunk = found->base;
+                continue;
+            }
+
+            out = *found;
+            return Status::Known;
+        }
+    };
+
+    /// The whole of a numeral, forcing each of its bases. The thunk is updated with
+    /// as much as is known of it, so that it is never walked again from the start.
+    auto count = [&](const ThunkPtr& whole, std::uint64_t& out)
+    {
+        bool walked = false;
+
+        out = 0;
+        for (ThunkPtr thunk = whole;;)
+        {
+            Layer outer;
+            if (auto status = layer(thunk, outer); status != Status::Known) return status;
+
+            out += outer.count;
+            if (!outer.base) break;
+
+            thunk = outer.base;
+            whole->value = number(out, thunk);
+            walked = true;
+        }
+
+        if (walked) whole->value = number(out, nullptr);
+        return Status::Known;
+    };
+
+    switch (op)
+    {
+    case Op::Add:
+    {
+        // a -> b -> a Incr b
+
+        Layer l;
+        if (auto status = layer(a, l); status != Status::Known) return status == Status::Forcing;
+
+        if (l.count == 0) enter(b);
+        else if (l.base) value = number(l.count, call(Op::Add, l.base, b));
+        else if (auto m = known(numerals, b)) value = number(l.count + *m, nullptr);
+        else value = number(l.count, b);
+
+        return true;
+    }
+
+    case Op::Mult:
+    {
+        // a -> b -> a (Add b) 0
+
+        Layer la;
+        if (auto status = layer(a, la); status != Status::Known) return status == Status::Forcing;
+
+        if (la.count == 0)
+        {
+            value = number(0, nullptr);
+            return true;
+        }
+
+        Layer lb;
+        if (auto status = layer(b, lb); status != Status::Known) return status == Status::Forcing;
+
+        auto rest = la.base ? call(Op::Mult, la.base, b) : nullptr;
+
+        if (lb.count == 0)
+        {
+            if (rest) enter(rest);
+            else value = number(0, nullptr);
+        }
+        else if (!lb.base) value = number(la.count * lb.count, rest);
+        else
+        {
+            // Only the first count of b's successors are known, so add the rest lazily
+            auto product = call(Op::Mult, successors(la.count - 1, la.base), b);
+            value = number(lb.count, call(Op::Add, lb.base, product));
+        }
+
+        return true;
+    }
+
+    case Op::IsZero:
+    {
+        // n -> n (_ -> False) True
+        Layer l;
+        if (auto status = layer(b, l); status != Status::Known) return status == Status::Forcing;
+
+        const auto& body = program.nodes[term];
+        Index result = l.count == 0 ? body.right : program.nodes[program.nodes[body.left].right].left;
+        enter(global(program.nodes[result].value));
+        return true;
+    }
+
+    case Op::Decr:
+    {
+        Layer l;
+        if (auto status = layer(b, l); status != Status::Known) return status == Status::Forcing;
+
+        if (!l.base) value = number(l.count > 0 ? l.count - 1 : 0, nullptr);
+        else if (l.count > 1) value = number(l.count - 1, call(Op::Decr, successors(1, l.base)));
+        else
+        {
+            // The predecessor of a successor of the base is the base, once it is known to be a numeral
+            Layer inner;
+            if (auto status = layer(l.base, inner); status != Status::Known) return status == Status::Forcing;
+            enter(l.base);
+        }
+
+        return true;
+    }
+
+    case Op::Sub:
+    {
+        // a -> b -> b Decr a, which forces all of b
+        std::uint64_t k;
+        if (auto status = count(b, k); status != Status::Known) return status == Status::Forcing;
+
+        if (k == 0)
+        {
+            enter(a);
+            return true;
+        }
+
+        std::uint64_t j = 0;
+        for (ThunkPtr thunk = a;; a->value = number(j, thunk))
+        {
+            Layer l;
+            if (auto status = layer(thunk, l); status != Status::Known) return status == Status::Forcing;
+
+            j += l.count;
+            if (!l.base)
+            {
+                value = number(j > k ? j - k : 0, nullptr);
+                return true;
+            }
+
+            // Only the successors above k are left once k are taken away
+            if (j > k)
+            {
+                value = number(j - k, call(Op::Sub, successors(k, l.base), successors(k, nullptr)));
+                return true;
+            }
+
+            thunk = l.base;
+        }
+    }
+
+    default:
+        return false;
+    }
+}
+
+void Core::primitive(Index builtin)
+{
+    const auto& numerals = program.numerals;
+
+    const auto& node = program.nodes[builtin];
+    const auto& primitive = Builtins::get(node.value);
+
+    auto expected = [&](const char* type, const ValuePtr& value)
+    {
+        return evaluation_error(
+            "`" + primitive.name.str() + "` expects " + type +
+            ", but was given " + readBack(program, value)->toString());
+    };
+
+    std::vector<Builtins::Datum> arguments;
+    for (std::size_t i = 0; i < primitive.arity(); i++)
+    {
+        const ThunkPtr& whole = lookup(env, primitive.arity() - 1 - i);
+
+        if (primitive.parameters[i] == Builtins::Type::String)
+        {
+            const auto& current = evaluated(whole);
+            if (!current)
+            {
+                stack.push_back({ Frame::Kind::Native, nullptr, nullptr, builtin, env });
+                enter(whole);
+                return;
+            }
+
+            if (current->kind != Value::Kind::String) throw expected("a string", current);
+            arguments.push_back(current->str.flatten());
+            continue;
+        }
+
+        // A numeral is counted a layer at a time, remembering how far it got in the thunk
+        std::uint64_t count = 0;
+        for (ThunkPtr thunk = whole;;)
+        {
+            const auto& current = evaluated(thunk);
+            if (!current)
+            {
+                if (thunk != whole) whole->value = number(count, thunk);
+                stack.push_back({ Frame::Kind::Native, nullptr, nullptr, builtin, env });
+                enter(thunk);
+                return;
+            }
+
+            auto layer = numeral(numerals, *current);
+            if (!layer) throw expected("a numeral", current);
+
+            count += layer->count;
+            if (!layer->base) break;
+            thunk = layer->base;
+        }
+
+        arguments.push_back(count);
+    }
+
+    auto result = primitive.apply(arguments);
+
+    switch (primitive.result)
+    {
+    case Builtins::Type::String:
+        value = make_arena_shared<Value>(std::get<std::string>(result));
+        break;
+
+    case Builtins::Type::Number:
+        if (numerals.zero == IR::none || numerals.incr == IR::none)
+            throw evaluation_error("`" + primitive.name.str() + "` returns a numeral, but none are defined");
+        value = number(std::get<std::uint64_t>(result), nullptr);
+        break;
+
+    case Builtins::Type::Bool:
+        value = make_arena_shared<Value>(std::get<bool>(result) ? node.left : node.right, nullptr);
+        break;
+    }
+}
+
+ThunkPtr Evaluator::suspend(Index term, const EnvironmentPtr& env)
+{
+    const auto& node = program.nodes[term];
+
+    switch (node.kind)
+    {
+    case IR::Node::Kind::Variable:
+        return lookup(env, node.value);
+
+    case IR::Node::Kind::Lambda:
+        return make_arena_shared<Thunk>(make_arena_shared<Value>(term, env));
+
+    case IR::Node::Kind::String:
+        return make_arena_shared<Thunk>(make_arena_shared<Value>(program.strings[node.value]));
+
+    default:
+        return make_arena_shared<Thunk>(term, env);
+    }
+}
+
+Async::Task<ValuePtr> Evaluator::run(Index root, Async::Budget budget)
+{
+    term = root;
+    env = nullptr;
+    value = nullptr;
+    stack.clear();
+
+    while (true)
+    {
+        if (budget.steps && taken == budget.steps)
+            throw evaluation_error("Exceeded the budget of " + std::to_string(budget.steps) + " steps");
+
+        taken++;
+        if (budget.slice && taken % budget.slice == 0)
+        {
+            auto arena = Arena::current();
+            if (budget.memory && arena && arena->bytesReserved() > budget.memory)
+                throw evaluation_error("Exceeded the budget of " + std::to_string(budget.memory) + " bytes");
+
+            co_await std::suspend_always();
+        }
+
+        if (value)
+        {
+            if (!pass()) co_return value;
+            continue;
+        }
+
+        const auto& node = program.nodes[term];
+
+        switch (node.kind)
+        {
+        case IR::Node::Kind::Variable:
+            enter(lookup(env, node.value));
+            break;
+
+        case IR::Node::Kind::Global:
+            enter(global(node.value));
+            break;
+
+        case IR::Node::Kind::Lambda:
+            value = make_arena_shared<Value>(term, env);
+            break;
+
+        case IR::Node::Kind::String:
+            value = make_arena_shared<Value>(program.strings[node.value]);
+            break;
+
+        case IR::Node::Kind::Application:
+            stack.push_back({ Frame::Kind::Argument, suspend(node.right, env) });
+            term = node.left;
+            break;
+
+        case IR::Node::Kind::Let:
+            env = make_arena_shared<Environment>(suspend(node.left, env), env);
+            term = node.right;
+            break;
+
+        case IR::Node::Kind::StrictLet:
+            sequence(suspend(node.left, env), node.right);
+            break;
+
+        case IR::Node::Kind::Builtin:
+            primitive(term);
+            break;
+        }
+    }
+}
+
+namespace
+{
+
+/// Reads back values and thunks, which it numbers by their position in values and thunks,
+/// with the lowest bit telling which. Environments are numbered by their position in envs.
+class Reader : public IR::Reader
+{
+public:
+    using IR::Reader::Reader;
+
+    Handle of(ValuePtr value)
+    {
+        values.push_back(std::move(value));
+        return Handle(values.size() - 1) << 1;
+    }
+
+    Handle of(ThunkPtr thunk)
+    {
+        thunks.push_back(std::move(thunk));
+        return Handle(thunks.size() - 1) << 1 | 1;
+    }
+
+protected:
+    void visit(Handle handle) override
+    {
+        if (handle & 1)
+        {
+            const auto thunk = thunks[handle >> 1];
+
+            // References to globals read back as their name, as they would be substituted
+            if (thunk->term != IR::none && program.nodes[thunk->term].kind == IR::Node::Kind::Global)
+                name(program.globals[program.nodes[thunk->term].value].name);
+            else if (thunk->value) alias(of(thunk->value));
+            else if (thunk->alias) alias(of(thunk->alias));
+            else term(thunk->term, env(thunk->env));
+            return;
+        }
+
+        const auto value = values[handle >> 1];
+        if (value->kind == Value::Kind::String)
+            expression(make_arena_shared<AST::String>(value->str));
+        else if (value->kind == Value::Kind::Number)
+            alias(of(expand(program, *value)));
+        else
+            term(value->lambda, env(value->env));
+    }
+
+    Handle variable(Handle env, std::uint32_t index) override
+    { return of(lookup(envs[env], index)); }
+
+private:
+    std::vector<ValuePtr> values;
+    std::vector<ThunkPtr> thunks;
+    std::vector<EnvironmentPtr> envs;
+
+    Handle env(EnvironmentPtr env)
+    {
+        envs.push_back(std::move(env));
+        return envs.size() - 1;
+    }
+};
+
+}
+
+AST::ExpressionPtr readBack(const IR::Program& program, const ValuePtr& value)
+{
+    Reader reader(program);
+    return reader.read(reader.of(value));
+}
+
+AST::ExpressionPtr readBack(const IR::Program& program, const ThunkPtr& thunk)
+{
+    Reader reader(program);
+    return reader.read(reader.of(thunk));
+}
+
+Evaluation::Evaluation(IR::Program& program, const AST::Expression& expr, Async::Budget budget) :
+    program(program),
+    evaluator(program)
+{
+    Arena::Scope scope(&arena);
+    scratch.emplace(program);
+    task = evaluator.start(expr, budget);
+}
+
+bool Evaluation::resume()
+{
+    if (finished) return true;
+
+    Arena::Scope scope(&arena);
+    if (!task.resume()) return false;
+
+    try
+    {
+        auto result = task.result();
+
+        // Read back on the heap, so that the expression outlives the arena
+        Arena::Scope heap(nullptr);
+        value = readBack(program, result);
+    } catch (...)
+    {
+        error = std::current_exception();
+    }
+
+    task.reset();
+    scratch.reset();
+    finished = true;
+    return true;
+}
+
+void Evaluation::cancel()
+{
+    if (finished) return;
+
+    task.reset();
+    scratch.reset();
+    error = std::make_exception_ptr(evaluation_error("Cancelled"));
+    finished = true;
+}
+
+AST::ExpressionPtr Evaluation::result() const
+{
+    if (error) std::rethrow_exception(error);
+    return value;
+}
+
+bool Scheduler::step()
+{
+    for (auto count = pending.size(); count > 0; count--)
+    {
+        auto evaluation = std::move(pending.front());
+        pending.pop_front();
+
+        if (!evaluation->resume()) pending.push_back(std::move(evaluation));
+    }
+
+    return !pending.empty();
+}
+
+}
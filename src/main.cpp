@@ -1,8 +1,13 @@
 #include <iostream>
 #include <fstream>
+#include <memory>
 #include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include "headers/interpreter.hpp"
+#include "headers/server.hpp"
 
 int main(const int argc, const char** const argv)
 {
@@ -12,8 +17,20 @@ int main(const int argc, const char** const argv)
 
     bool interactiveMode = false;
     bool runMain = false;
+    bool stats = false;
+    bool lazy = false;
+    bool batch = false;
+    bool parallel = false;
+    Async::Budget budget;
+    std::string serve;
+    std::string client;
+    auto engine = Interpreter::Engine::Substitution;
+
+    // The files are loaded at once, though they are still run in order
+    auto loader = std::make_shared<ModuleLoader>();
 
     std::stringstream instructions;
+    std::vector<std::string> files;
     for (int i = 1; i < argc; i++)
     {
         if (argv[i][0] == '-')
@@ -21,21 +38,91 @@ int main(const int argc, const char** const argv)
             std::string s(argv[i]);
             if (s == "-i" || s == "--interactive") interactiveMode = true;
             if (s == "-r" || s == "--run") runMain = true;
+            if (s == "-g" || s == "--graph") engine = Interpreter::Engine::Graph;
+            if (s == "-m" || s == "--machine") engine = Interpreter::Engine::Machine;
+            if (s == "-b" || s == "--bytecode") engine = Interpreter::Engine::Bytecode;
+            if (s == "-s" || s == "--stats") stats = true;
+            if (s == "-l" || s == "--lazy") lazy = true;
+            if (s == "--batch") batch = true;
+            if (s == "-p" || s == "--parallel") parallel = true;
+            if (s == "--max-steps" && i + 1 < argc) budget.steps = std::stoull(argv[++i]);
+            if (s == "--max-memory" && i + 1 < argc) budget.memory = std::stoull(argv[++i]);
+            if (s == "--serve" && i + 1 < argc) serve = argv[++i];
+            if (s == "--client" && i + 1 < argc) client = argv[++i];
         }
         else // Add running the file to the initial program string
+        {
             instructions << "#include " << '"' << argv[i] << '"' << std::endl;
+            files.push_back(argv[i]);
+        }
     }
 
     // Add call to run Main, if requested
     if (runMain) instructions << "Main" << std::endl;
 
+    // Send the files to a server to run, rather than loading anything here
+    if (!client.empty())
+    {
+        std::stringstream source;
+        for (const auto& file : files)
+        {
+            std::ifstream stream(file + ".lambda");
+            if (stream.fail())
+            {
+                std::cerr << "Include Error: Failed to open file: \"" << file << ".lambda\"" << std::endl;
+                return 1;
+            }
+            source << stream.rdbuf() << std::endl;
+        }
+        if (runMain) source << "Main" << std::endl;
+
+        return Server::request(client, source.str(), std::cout, std::cerr);
+    }
+
+    // The modules a lazy interpreter defers are outlined, and only loaded if they are run
+    loader->eager = !lazy || batch;
+    for (const auto& file : files) loader->prefetch(file);
+
+    // A batch already evaluates on every core, a server evaluates requests at once,
+    // and with only one core, forking would only add the cost of handing terms over
+    std::shared_ptr<Parallel::Pool> pool;
+    if (parallel && !batch && serve.empty() && std::thread::hardware_concurrency() > 1)
+        pool = std::make_shared<Parallel::Pool>();
+
     // Run included files
     StreamInterpreter includesInterpreter(instructions);
+    includesInterpreter.loader = loader;
+    includesInterpreter.engine = engine;
+    includesInterpreter.stats = stats;
+    includesInterpreter.pool = pool;
+    includesInterpreter.budget = budget;
+    // A batch only reads the bindings, so everything it may use is bound first
+    includesInterpreter.lazy = lazy && !batch;
     BindingTable fileBindings = includesInterpreter.run();
 
+    // Keep the bindings loaded, and run the source of each request against them
+    if (!serve.empty()) return Server::serve(includesInterpreter, serve);
+
+    // Evaluate the lines of standard input at once, if requested
+    if (batch)
+    {
+        Batch(includesInterpreter).run(std::cin, std::cout, std::cerr);
+        return 0;
+    }
+
     // Start interactive repl, if requested
     if (interactiveMode)
-        Repl().run(fileBindings, includesInterpreter.includes);
+    {
+        Repl repl;
+        repl.loader = loader;
+        repl.engine = engine;
+        repl.stats = stats;
+        repl.pool = pool;
+        repl.budget = budget;
+        repl.lazy = lazy;
+        repl.deferred = std::move(includesInterpreter.deferred);
+        repl.run(&fileBindings, &includesInterpreter.includes);
+    }
 
     return 0;
 }
@@ -0,0 +1,421 @@
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "headers/module.hpp"
+#include "headers/arena.hpp"
+#include "headers/ast.hpp"
+
+namespace LambdaCalc::Module
+{
+
+namespace
+{
+
+/// The first bytes of every cache
+constexpr char magic[4] = { 'L', 'C', 'M', 'C' };
+
+/// Magic, format version, AST version, then source hash
+constexpr std::size_t headerSize = sizeof(magic) + 2 * sizeof(std::uint32_t) + sizeof(std::uint64_t);
+
+enum Tag : std::uint8_t
+{
+    // Expressions, each following its children
+    Name,           ///< name
+    String,         ///< string
+    Bracket,        ///< expr
+    Application,    ///< left right
+    Mapping,        ///< to, then the name bound
+    Let,            ///< value expr, then the name bound
+    Where,          ///< expr value, then the name bound
+
+    // Lines, each following its expression
+    BindingLine,    ///< to, then the name bound
+    ExpressionLine, ///< expr
+    IncludeLine,    ///< name
+    BuiltinLine     ///< name
+};
+
+}
+
+std::uint64_t hash(std::string_view source)
+{
+    std::uint64_t hash = 0xcbf29ce484222325;
+    for (unsigned char c : source)
+    {
+        hash ^= c;
+        hash *= 0x100000001b3;
+    }
+    return hash;
+}
+
+std::string cachePath(const std::string& name)
+{ return name + ".lambda.cache"; }
+
+/// The tables of embedded modules, made findable at startup
+static std::vector<std::pair<const Embedded*, std::size_t>>& libraries()
+{
+    static std::vector<std::pair<const Embedded*, std::size_t>> libraries;
+    return libraries;
+}
+
+const Embedded* Embedded::find(const std::string& name)
+{
+    for (auto [modules, count] : libraries())
+    for (std::size_t i = 0; i < count; i++)
+        if (name == modules[i].name) return &modules[i];
+
+    return nullptr;
+}
+
+Library::Library(const Embedded* modules, std::size_t count)
+{ libraries().push_back({ modules, count }); }
+
+void Writer::number(std::uint64_t n)
+{
+    // Seven bits at a time, lowest first, with the top bit set on all but the last
+    while (n >= 0x80)
+    {
+        bytes += char((n & 0x7f) | 0x80);
+        n >>= 7;
+    }
+    bytes += char(n);
+}
+
+void Writer::text(std::string_view str)
+{
+    number(str.size());
+    bytes += str;
+}
+
+void Writer::expression(const AST::Expression& root)
+{
+    /// An expression to write, after its children have been
+    struct Task
+    {
+        const AST::Expression* expr;
+        bool children = false;
+    };
+
+    std::vector<Task> tasks { { &root } };
+
+    while (!tasks.empty())
+    {
+        auto task = tasks.back();
+        tasks.pop_back();
+        const auto* expr = task.expr;
+
+        if (!task.children)
+        {
+            tasks.push_back({ expr, true });
+
+            // Pushed in reverse, so they are written in order
+            if (auto bracket = dynamic_cast<const AST::BracketExpr*>(expr))
+                tasks.push_back({ bracket->expr.get() });
+            else if (auto application = dynamic_cast<const AST::ApplicationExpr*>(expr))
+            {
+                tasks.push_back({ application->right.get() });
+                tasks.push_back({ application->left.get() });
+            }
+            else if (auto mapping = dynamic_cast<const AST::Mapping*>(expr))
+                tasks.push_back({ mapping->to.get() });
+            else if (auto let = dynamic_cast<const AST::LetExpr*>(expr))
+            {
+                tasks.push_back({ let->expr.get() });
+                tasks.push_back({ let->binding->to.get() });
+            }
+            else if (auto where = dynamic_cast<const AST::WhereExpr*>(expr))
+            {
+                tasks.push_back({ where->binding->to.get() });
+                tasks.push_back({ where->expr.get() });
+            }
+
+            continue;
+        }
+
+        if (auto name = dynamic_cast<const AST::Name*>(expr))
+        {
+            bytes += char(Name);
+            text(name->name.str());
+        }
+        else if (auto str = dynamic_cast<const AST::String*>(expr))
+        {
+            bytes += char(String);
+            text(str->str.flatten());
+        }
+        else if (dynamic_cast<const AST::BracketExpr*>(expr))
+            bytes += char(Bracket);
+        else if (dynamic_cast<const AST::ApplicationExpr*>(expr))
+            bytes += char(Application);
+        else if (auto mapping = dynamic_cast<const AST::Mapping*>(expr))
+        {
+            bytes += char(Mapping);
+            text(mapping->from.name.str());
+        }
+        else if (auto let = dynamic_cast<const AST::LetExpr*>(expr))
+        {
+            bytes += char(Let);
+            text(let->binding->from.name.str());
+        }
+        else if (auto where = dynamic_cast<const AST::WhereExpr*>(expr))
+        {
+            bytes += char(Where);
+            text(where->binding->from.name.str());
+        }
+        else throw std::logic_error("Cannot serialize expression: " + expr->toString());
+    }
+}
+
+void Writer::write(const AST::Line& line)
+{
+    if (failed) return;
+
+    if (auto binding = dynamic_cast<const AST::Binding*>(&line))
+    {
+        expression(*binding->to);
+        bytes += char(BindingLine);
+        text(binding->from.name.str());
+    }
+    else if (auto expr = dynamic_cast<const AST::Expression*>(&line))
+    {
+        expression(*expr);
+        bytes += char(ExpressionLine);
+    }
+    else if (auto include = dynamic_cast<const AST::Include*>(&line))
+    {
+        bytes += char(IncludeLine);
+        text(include->name);
+    }
+    else if (auto builtin = dynamic_cast<const AST::BuiltinDecl*>(&line))
+    {
+        bytes += char(BuiltinLine);
+        text(builtin->name.str());
+    }
+}
+
+void Writer::save(const std::string& path, std::uint64_t sourceHash) const
+{
+    if (failed) return;
+
+    std::string temporary = path + "." + std::to_string(getpid());
+    {
+        std::ofstream file(temporary, std::ios::binary);
+        if (file.fail()) return;
+
+        auto cache = serialize(sourceHash);
+        file.write(cache.data(), cache.size());
+
+        if (file.fail())
+        {
+            file.close();
+            std::remove(temporary.c_str());
+            return;
+        }
+    }
+
+    if (std::rename(temporary.c_str(), path.c_str()) != 0)
+        std::remove(temporary.c_str());
+}
+
+std::string Writer::serialize(std::uint64_t sourceHash) const
+{
+    std::uint32_t version = formatVersion;
+    std::uint32_t ast = astVersion;
+
+    std::string cache(magic, sizeof(magic));
+    cache.append(reinterpret_cast<const char*>(&version), sizeof(version));
+    cache.append(reinterpret_cast<const char*>(&ast), sizeof(ast));
+    cache.append(reinterpret_cast<const char*>(&sourceHash), sizeof(sourceHash));
+    cache += bytes;
+    return cache;
+}
+
+std::unique_ptr<Reader> Reader::open(const std::string& path, std::uint64_t sourceHash)
+{
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return nullptr;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || std::size_t(info.st_size) < headerSize)
+    {
+        close(fd);
+        return nullptr;
+    }
+
+    std::size_t size = info.st_size;
+    void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) return nullptr;
+
+    std::unique_ptr<Reader> reader(new Reader(static_cast<const char*>(mapping), size, true));
+    if (!reader->valid(&sourceHash)) return nullptr;
+    return reader;
+}
+
+std::unique_ptr<Reader> Reader::open(const Embedded& module)
+{
+    if (module.size < headerSize) return nullptr;
+
+    std::unique_ptr<Reader> reader(new Reader(reinterpret_cast<const char*>(module.data), module.size, false));
+    if (!reader->valid(nullptr)) return nullptr;
+    return reader;
+}
+
+Reader::~Reader()
+{ if (mapped) munmap(const_cast<char*>(data), size); }
+
+bool Reader::valid(const std::uint64_t* sourceHash)
+{
+    std::uint32_t version, ast;
+    std::uint64_t hash;
+    std::memcpy(&version, data + sizeof(magic), sizeof(version));
+    std::memcpy(&ast, data + sizeof(magic) + sizeof(version), sizeof(ast));
+    std::memcpy(&hash, data + sizeof(magic) + sizeof(version) + sizeof(ast), sizeof(hash));
+
+    if (std::memcmp(data, magic, sizeof(magic)) != 0 || version != formatVersion || ast != astVersion)
+        return false;
+    if (sourceHash && hash != *sourceHash)
+        return false;
+
+    position = headerSize;
+    return true;
+}
+
+std::uint8_t Reader::byte()
+{
+    if (position >= size) throw std::runtime_error("Module cache is truncated");
+    return data[position++];
+}
+
+std::uint64_t Reader::number()
+{
+    std::uint64_t n = 0;
+    for (int shift = 0;; shift += 7)
+    {
+        std::uint8_t b = byte();
+        n |= std::uint64_t(b & 0x7f) << shift;
+        if (!(b & 0x80)) return n;
+    }
+}
+
+std::string_view Reader::text()
+{
+    auto length = number();
+    if (length > size - position) throw std::runtime_error("Module cache is truncated");
+
+    std::string_view str(data + position, length);
+    position += length;
+    return str;
+}
+
+std::shared_ptr<const AST::Line> Reader::next()
+{
+    std::vector<AST::ExpressionPtr> stack;
+
+    auto pop = [&]()
+    {
+        if (stack.empty()) throw std::runtime_error("Module cache is corrupt");
+        auto expr = std::move(stack.back());
+        stack.pop_back();
+        return expr;
+    };
+
+    // A line is made of exactly what was pushed since the last
+    auto last = [&]()
+    {
+        auto expr = pop();
+        if (!stack.empty()) throw std::runtime_error("Module cache is corrupt");
+        return expr;
+    };
+
+    auto name = [&]() { return AST::Name(Symbol(std::string(text()))); };
+
+    while (true)
+    {
+        switch (Tag(byte()))
+        {
+        case Name:
+            stack.push_back(make_arena_shared<AST::Name>(name()));
+            break;
+
+        case String:
+            stack.push_back(make_arena_shared<AST::String>(std::string(text())));
+            break;
+
+        case Bracket:
+            stack.push_back(make_arena_shared<AST::BracketExpr>(pop()));
+            break;
+
+        case Application:
+        {
+            // The cache is not trusted, so the right side is checked to be simple, as parsed
+            auto right = std::dynamic_pointer_cast<const AST::SimpleExpr>(pop());
+            auto left = pop();
+            if (!right) throw std::runtime_error("Module cache is corrupt");
+
+            stack.push_back(make_arena_shared<AST::ApplicationExpr>(std::move(left), std::move(right)));
+            break;
+        }
+
+        case Mapping:
+            stack.push_back(make_arena_shared<AST::Mapping>(name(), pop()));
+            break;
+
+        case Let:
+        {
+            auto expr = pop();
+            auto value = pop();
+            stack.push_back(make_arena_shared<AST::LetExpr>(
+                make_arena_shared<AST::Binding>(name(), std::move(value)),
+                std::move(expr)
+            ));
+            break;
+        }
+
+        case Where:
+        {
+            auto value = pop();
+            auto expr = pop();
+            stack.push_back(make_arena_shared<AST::WhereExpr>(
+                std::move(expr),
+                make_arena_shared<AST::Binding>(name(), std::move(value))
+            ));
+            break;
+        }
+
+        case BindingLine:
+        {
+            auto to = last();
+            return make_arena_shared<AST::Binding>(name(), std::move(to));
+        }
+
+        case ExpressionLine:
+            return last();
+
+        case IncludeLine:
+            if (!stack.empty()) throw std::runtime_error("Module cache is corrupt");
+            return make_arena_shared<AST::Include>(std::string(text()));
+
+        case BuiltinLine:
+            if (!stack.empty()) throw std::runtime_error("Module cache is corrupt");
+            return make_arena_shared<AST::BuiltinDecl>(Symbol(std::string(text())));
+
+        default:
+            throw std::runtime_error("Module cache is corrupt");
+        }
+    }
+}
+
+}
@@ -0,0 +1,286 @@
+#include <array>
+#include <cctype>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "headers/ir.hpp"
+
+namespace LambdaCalc::IR
+{
+
+namespace
+{
+
+/// The definitions recognised, and those they refer to
+enum Shape { Zero, True, False, Incr, Pair, Fst, Snd, Add, Mult, IsZero, Decr, Sub, ShapeCount };
+
+const char* const shapeNames[ShapeCount] = {
+    "Zero", "True", "False", "Incr", "Pair", "Fst", "Snd", "Add", "Mult", "IsZero", "Decr", "Sub"
+};
+
+/// The definitions of natural.lambda, and those it uses, as de Bruijn terms.
+/// `\` binds a variable over the rest of its term, and a name is any global
+/// whose definition has that shape, whatever it is called.
+const char* const shapePatterns[ShapeCount] = {
+    "\\ \\ 0",
+    "\\ \\ 1",
+    "\\ \\ 0",
+    "\\ \\ \\ 1 (2 1 0)",
+    "\\ \\ \\ 0 2 1",
+    "\\ 0 (\\ \\ 1)",
+    "\\ 0 (\\ \\ 0)",
+    "\\ \\ 1 Incr 0",
+    "\\ \\ 1 (Add 0) Zero",
+    "\\ 0 (\\ False) True",
+    "\\ let (\\ Pair (Snd 0) (Incr (Snd 0))) in Fst (1 0 (Pair Zero Zero))",
+    "\\ \\ 0 Decr 1",
+};
+
+/// A term of a shape. Global patterns hold the shape their global must have.
+struct Pattern
+{
+    Node::Kind kind;
+    std::uint32_t value = 0;
+    std::size_t left = 0;
+    std::size_t right = 0;
+};
+
+class Patterns
+{
+public:
+    std::vector<Pattern> patterns;
+    std::array<std::size_t, ShapeCount> roots;
+
+    Patterns()
+    {
+        for (int shape = 0; shape < ShapeCount; shape++)
+        {
+            const char* source = shapePatterns[shape];
+            roots[shape] = parse(source);
+        }
+    }
+
+private:
+    std::size_t push(Pattern pattern)
+    {
+        patterns.push_back(pattern);
+        return patterns.size() - 1;
+    }
+
+    static void skip(const char*& source)
+    { while (*source == ' ') source++; }
+
+    static bool startsWith(const char* source, const char* word)
+    { return std::char_traits<char>::compare(source, word, std::char_traits<char>::length(word)) == 0; }
+
+    static bool keyword(const char*& source, const char* word)
+    {
+        skip(source);
+        if (!startsWith(source, word)) return false;
+
+        source += std::char_traits<char>::length(word);
+        return true;
+    }
+
+    /// term ::= `\` term | `let` term `in` term | atom+
+    std::size_t parse(const char*& source)
+    {
+        skip(source);
+
+        if (*source == '\\')
+        {
+            source++;
+            std::size_t body = parse(source);
+            return push({ Node::Kind::Lambda, 0, body });
+        }
+
+        if (keyword(source, "let "))
+        {
+            std::size_t value = parse(source);
+            if (!keyword(source, "in ")) throw std::logic_error("Expected `in` in numeral pattern");
+            std::size_t body = parse(source);
+            return push({ Node::Kind::Let, 0, value, body });
+        }
+
+        std::size_t term = atom(source);
+        while (true)
+        {
+            skip(source);
+            if (*source == 0 || *source == ')' || startsWith(source, "in ")) break;
+            term = push({ Node::Kind::Application, 0, term, atom(source) });
+        }
+
+        return term;
+    }
+
+    /// atom ::= `(` term `)` | variable | shape
+    std::size_t atom(const char*& source)
+    {
+        skip(source);
+
+        if (*source == '(')
+        {
+            source++;
+            std::size_t term = parse(source);
+            skip(source);
+            source++;
+            return term;
+        }
+
+        if (std::isdigit(*source))
+            return push({ Node::Kind::Variable, std::uint32_t(*source++ - '0') });
+
+        for (int shape = 0; shape < ShapeCount; shape++)
+        {
+            const char* name = shapeNames[shape];
+            auto length = std::char_traits<char>::length(name);
+            if (startsWith(source, name) && !std::isalpha(source[length]))
+            {
+                source += length;
+                return push({ Node::Kind::Global, std::uint32_t(shape) });
+            }
+        }
+
+        throw std::logic_error(std::string("Unknown name in numeral pattern: ") + source);
+    }
+};
+
+const Patterns& patterns()
+{
+    static const Patterns patterns;
+    return patterns;
+}
+
+/// Matches the globals of a program against the shapes, remembering each result
+class Matcher
+{
+public:
+    Matcher(const Program& program) :
+        program(program),
+        results(program.globals.size())
+    { referenced.fill(none); }
+
+    /// @brief The last global of each shape that another was found to refer to
+    std::array<Slot, ShapeCount> referenced;
+
+    /// @return Whether the definition of a global has a shape
+    bool is(Slot slot, Shape shape)
+    {
+        auto& result = results[slot][shape];
+        if (result != Unknown) return result == Yes;
+
+        // A definition that refers to itself is not any of the shapes
+        result = No;
+
+        Index root = program.globals[slot].root;
+        bool matches = root != none && match(patterns().roots[shape], root);
+        result = matches ? Yes : No;
+        return matches;
+    }
+
+private:
+    enum Result : std::uint8_t { Unknown, No, Yes };
+
+    const Program& program;
+    std::vector<std::array<Result, ShapeCount>> results;
+
+    bool match(std::size_t p, Index index)
+    {
+        const auto& pattern = patterns().patterns[p];
+        const auto& node = program.nodes[index];
+
+        if (pattern.kind != node.kind) return false;
+
+        switch (node.kind)
+        {
+        case Node::Kind::Variable:
+            return pattern.value == node.value;
+
+        case Node::Kind::Global:
+            if (!is(node.value, Shape(pattern.value))) return false;
+            referenced[pattern.value] = node.value;
+            return true;
+
+        case Node::Kind::Lambda:
+            return match(pattern.left, node.left);
+
+        case Node::Kind::Application:
+        case Node::Kind::Let:
+            return match(pattern.left, node.left) && match(pattern.right, node.right);
+
+        default:
+            return false;
+        }
+    }
+};
+
+}
+
+void Numerals::recognise(Program& program)
+{
+    ops.assign(program.nodes.size(), Op::None);
+
+    Matcher matcher(program);
+    std::array<bool, 8> called = {};
+
+    const std::pair<Shape, Op> operations[] = {
+        { Add, Op::Add }, { Mult, Op::Mult }, { IsZero, Op::IsZero }, { Decr, Op::Decr }, { Sub, Op::Sub }
+    };
+
+    for (Slot slot = 0; slot < program.globals.size(); slot++)
+    {
+        Index root = program.globals[slot].root;
+
+        // Any closure of these is a numeral, whichever global it came from
+        if (matcher.is(slot, Zero)) ops[root] = Op::Zero;
+        if (matcher.is(slot, Incr)) ops[program.nodes[root].left] = Op::Successor;
+
+        for (auto [shape, op] : operations)
+        {
+            if (!matcher.is(slot, shape)) continue;
+
+            // The operation runs once its innermost lambda has its argument
+            Index lambda = root;
+            while (program.nodes[program.nodes[lambda].left].kind == Node::Kind::Lambda)
+                lambda = program.nodes[lambda].left;
+            ops[lambda] = op;
+
+            // The first global of each operation is called. Its call is kept between
+            // recognitions, unless that global has changed.
+            if (called[std::size_t(op)]) continue;
+            called[std::size_t(op)] = true;
+
+            auto& call = calls[std::size_t(op)];
+            bool binary = op != Op::IsZero && op != Op::Decr;
+            Index head = call == none ? none : program.nodes[call].left;
+            if (binary && head != none) head = program.nodes[head].left;
+            if (head != none && program.nodes[head].value == slot) continue;
+
+            auto& nodes = program.nodes;
+            Index global = nodes.size();
+            nodes.push_back({ Node::Kind::Global, slot });
+            if (binary)
+            {
+                nodes.push_back({ Node::Kind::Variable, 1 });
+                nodes.push_back({ Node::Kind::Application, 0, global, global + 1 });
+                global += 2;
+            }
+            nodes.push_back({ Node::Kind::Variable, 0 });
+            nodes.push_back({ Node::Kind::Application, 0, global, global + 1 });
+            call = nodes.size() - 1;
+        }
+    }
+
+    // Numbers are built from the zero and successor the operations use, such as `0`
+    // rather than Bool::False, so that they read back as they would have been written
+    Slot zeroSlot = matcher.referenced[Zero];
+    Slot incrSlot = matcher.referenced[Incr];
+    zero = zeroSlot == none ? none : program.globals[zeroSlot].root;
+    incr = incrSlot == none ? none : program.nodes[program.globals[incrSlot].root].left;
+
+    // Each operation needs them to build its result from
+    if (zero == none || incr == none) ops.clear();
+}
+
+}
@@ -0,0 +1,163 @@
+#include <algorithm>
+#include <exception>
+#include <memory>
+#include <mutex>
+
+#include "headers/parallel.hpp"
+#include "headers/arena.hpp"
+#include "headers/ast.hpp"
+
+namespace LambdaCalc::Parallel
+{
+
+static thread_local Pool* currentPool = nullptr;
+
+thread_local const Pool::Task* Pool::currentTask = nullptr;
+
+Pool* Pool::current()
+{ return currentPool; }
+
+Pool::Scope::Scope(Pool* pool, const BindingTable& bindings) : previous(currentPool)
+{
+    currentPool = pool;
+    if (!pool) return;
+
+    std::lock_guard lock(pool->mutex);
+    pool->bindings = &bindings;
+    pool->generation++;
+}
+
+Pool::Scope::~Scope()
+{ currentPool = previous; }
+
+Pool::Pool(unsigned threads)
+{
+    for (unsigned i = 0; i < std::max(threads, 1u); i++)
+        workers.emplace_back([this]() { work(); });
+}
+
+Pool::~Pool()
+{
+    {
+        std::lock_guard lock(mutex);
+        stopping = true;
+    }
+
+    queued.notify_all();
+    for (auto& worker : workers) worker.join();
+}
+
+bool Pool::saturated()
+{
+    std::lock_guard lock(mutex);
+    return queue.size() >= workers.size();
+}
+
+void Pool::interruptionPoint()
+{
+    for (auto task = currentTask; task; task = task->parent)
+        if (task->cancelled.load(std::memory_order_relaxed)) throw cancelled();
+}
+
+void Pool::run(Task& task, const BindingTable& bindings)
+{
+    auto previous = currentTask;
+    currentTask = &task;
+
+    try
+    {
+        task.result = task.expr->simplify(bindings);
+    } catch (...)
+    {
+        task.error = std::current_exception();
+    }
+
+    currentTask = previous;
+}
+
+void Pool::work()
+{
+    // Results outlive the tasks that made them, and are freed by other threads
+    Arena::Scope heap(nullptr);
+    currentPool = this;
+
+    BindingTable local;
+    std::uint64_t localGeneration = 0;
+
+    std::unique_lock lock(mutex);
+
+    while (true)
+    {
+        queued.wait(lock, [&]() { return stopping || !queue.empty(); });
+        if (stopping) return;
+
+        auto& task = *queue.front();
+        queue.pop_front();
+        task.state = Task::State::Running;
+
+        if (localGeneration != generation)
+        {
+            local = bindings->snapshot();
+            localGeneration = generation;
+        }
+
+        lock.unlock();
+        run(task, local);
+        lock.lock();
+
+        task.state = Task::State::Done;
+        done.notify_all();
+    }
+}
+
+Fork::Fork(Pool& pool, ExpressionPtr expr) : pool(pool)
+{
+    task.expr = std::move(expr);
+    task.parent = Pool::currentTask;
+
+    {
+        std::lock_guard lock(pool.mutex);
+        pool.queue.push_back(&task);
+    }
+
+    pool.queued.notify_one();
+}
+
+ExpressionPtr Fork::join(const BindingTable& bindings)
+{
+    finished = true;
+    std::unique_lock lock(pool.mutex);
+
+    // Rather than wait for a worker to get to it, simplify it here
+    if (task.state == Pool::Task::State::Queued)
+    {
+        pool.queue.erase(std::find(pool.queue.begin(), pool.queue.end(), &task));
+        task.state = Pool::Task::State::Running;
+        lock.unlock();
+
+        pool.run(task, bindings);
+        task.state = Pool::Task::State::Done;
+    }
+    else pool.done.wait(lock, [&]() { return task.state == Pool::Task::State::Done; });
+
+    if (task.error) std::rethrow_exception(task.error);
+    return std::move(task.result);
+}
+
+void Fork::cancel()
+{
+    if (finished) return;
+    finished = true;
+
+    std::unique_lock lock(pool.mutex);
+    if (task.state == Pool::Task::State::Queued)
+    {
+        pool.queue.erase(std::find(pool.queue.begin(), pool.queue.end(), &task));
+        return;
+    }
+
+    task.cancelled = true;
+    pool.done.wait(lock, [&]() { return task.state == Pool::Task::State::Done; });
+}
+
+}
@@ -1,6 +1,9 @@
 #include <memory>
 #include <concepts>
+#include <string>
+#include <string_view>
 
+#include "headers/lexer.hpp"
 #include "headers/parser.hpp"
 #include "headers/util.hpp"
 #include "headers/ast.hpp"
@@ -11,14 +14,14 @@ namespace LambdaCalc
 template<Parseable P>
 std::unique_ptr<P> Parser<P>::parse(std::string& source)
 {
-    const char* c_source = source.c_str();
-    auto result = parse(c_source);
+    auto tokens = tokenize(source);
+    const Token* cursor = tokens.data();
+    auto result = parse(cursor);
 
     /// Check if the whole string was parsed, if not, fail
-    remove_leading_whitespace(c_source);
-    if (&*c_source == &*source.end())
+    if (result && cursor->kind == Token::Kind::End)
     {
-        source = std::string(c_source);
+        source.clear();
         return result;
     }
 
@@ -26,49 +29,44 @@ std::unique_ptr<P> Parser<P>::parse(std::string& source)
 }
 
 template<Parseable P>
-std::unique_ptr<P> Parser<P>::parse(const char*& source)
+std::unique_ptr<P> Parser<P>::parse(const Token*& tokens)
 {
-    const char* copy = source;
+    const Token* copy = tokens;
 
     auto result = P::parse(copy);
     if (result == nullptr) return nullptr;
 
-    source = copy;
+    tokens = copy;
     return result;
 }
 
-void remove_leading_whitespace(const char*& source)
+/// Lines are also parsed by lambdac, which links against this parser
+template class Parser<AST::Line>;
+
+/// Advance past the next token if it is of a kind
+static bool match(const Token*& source, Token::Kind kind)
 {
-    const static std::string whitespace = " \t\r\n\v";
-    while (*source != 0)
-    {
-        bool is_whitespace = false;
-        for (const auto& c : whitespace)
-            is_whitespace |= *source == c;
-        
-        if (is_whitespace) source++;
-        else return;
-    }
+    if (source->kind != kind) return false;
+
+    source++;
+    return true;
 }
 
-bool match_exact_string(const char*& source, const std::string& comparison)
+/// Advance past the next token if it is a keyword, or a directive
+static bool match(const Token*& source, Token::Kind kind, std::string_view text)
 {
-    for (int i = 0; i < comparison.length(); i++)
-        if (source[i] != comparison[i]) return false;
-    
-    source += comparison.length();
+    if (source->kind != kind || source->text != text) return false;
+
+    source++;
     return true;
 }
 
-std::unique_ptr<AST::Line> AST::Line::parse(const char*& source)
+std::unique_ptr<AST::Line> AST::Line::parse(const Token*& source)
 {
     if (auto binding = Parser<AST::Binding>::parse(source))
         return binding;
 
-    if (auto whereExpr = Parser<AST::WhereExpr>::parse(source))
-        return whereExpr;
-    
-    if (auto expression = Parser<AST::Expression>::parse(source))
+    if (auto expression = AST::WhereExpr::parseQualified(source))
         return expression;
     
     if (auto comment = Parser<AST::Comment>::parse(source))
@@ -76,82 +74,105 @@ std::unique_ptr<AST::Line> AST::Line::parse(const char*& source)
     
     if (auto include = Parser<AST::Include>::parse(source))
         return include;
+
+    if (auto builtin = Parser<AST::BuiltinDecl>::parse(source))
+        return builtin;
     
     return nullptr;
 }
 
-std::unique_ptr<AST::Include> AST::Include::parse(const char*& source)
+std::unique_ptr<AST::Include> AST::Include::parse(const Token*& source)
 {
-    remove_leading_whitespace(source);
-    if (!match_exact_string(source, "#include")) return nullptr;
+    if (!match(source, Token::Kind::Directive, "include")) return nullptr;
 
     auto name = Parser<AST::String>::parse(source);
     if (!name) return nullptr;
 
-    return std::make_unique<AST::Include>(name->str);
+    return std::make_unique<AST::Include>(name->str.flatten());
 }
 
-std::unique_ptr<AST::Comment> AST::Comment::parse(const char*& source)
+std::unique_ptr<AST::BuiltinDecl> AST::BuiltinDecl::parse(const Token*& source)
 {
-    remove_leading_whitespace(source);
+    if (!match(source, Token::Kind::Directive, "builtin")) return nullptr;
+
+    auto name = Parser<AST::Name>::parse(source);
+    if (!name) return nullptr;
 
-    if (*source == '\0') return std::make_unique<Comment>();
+    return std::make_unique<AST::BuiltinDecl>(name->name);
+}
 
-    if (!match_exact_string(source, "//")) return nullptr;
+std::unique_ptr<AST::Comment> AST::Comment::parse(const Token*& source)
+{
+    if (source->kind == Token::Kind::End) return std::make_unique<Comment>();
 
-    while (*source != '\0' && *source != '\n') source++;
+    if (!match(source, Token::Kind::Comment)) return nullptr;
 
     return std::make_unique<Comment>();
 }
 
-std::unique_ptr<AST::Expression> AST::Expression::parse(const char*& source)
+/// An application is parsed a simple expression at a time, folding each into the spine,
+/// so that however many there are, each token is parsed once and the stack does not grow.
+/// A let or mapping takes the rest of the expression, as the last argument.
+std::unique_ptr<AST::Expression> AST::Expression::parse(const Token*& source)
 {
-    if (auto letExpr = Parser<AST::LetExpr>::parse(source))
-        return letExpr;
-    
-    if (auto mapping = Parser<AST::Mapping>::parse(source))
-        return mapping;
+    std::unique_ptr<AST::Expression> expr;
+
+    while (true)
+    {
+        std::unique_ptr<AST::Expression> last;
+        if (auto letExpr = Parser<AST::LetExpr>::parse(source))
+            last = std::move(letExpr);
+        else if (auto mapping = Parser<AST::Mapping>::parse(source))
+            last = std::move(mapping);
+
+        if (last)
+        {
+            if (!expr) return last;
+            return std::make_unique<AST::ApplicationExpr>(std::move(expr), SimpleExpr::wrap(std::move(last)));
+        }
 
-    auto simpleExpr = Parser<AST::SimpleExpr>::parse(source);
-    if (!simpleExpr) return nullptr;
+        auto simpleExpr = Parser<AST::SimpleExpr>::parse(source);
+        if (!simpleExpr) return expr;
 
-    auto rightExpr = Parser<AST::Expression>::parse(source);
-    std::unique_ptr<AST::Expression> expr = rightExpr
-        ? AST::ApplicationExpr::leftAppendSimpleExpr(std::move(simpleExpr), std::move(rightExpr))
-        : dynamic_pointer_cast<AST::Expression>(std::move(simpleExpr));
+        if (!expr) expr = std::move(simpleExpr);
+        else expr = std::make_unique<AST::ApplicationExpr>(std::move(expr), std::move(simpleExpr));
+    }
+}
 
-    return expr;
+std::unique_ptr<AST::WhereExpr> AST::WhereExpr::parse(const Token*& source)
+{
+    return dynamic_pointer_cast<AST::WhereExpr>(parseQualified(source));
 }
 
-std::unique_ptr<AST::WhereExpr> AST::WhereExpr::parse(const char*& source)
+/// The expression is parsed once, whether or not it turns out to be qualified.
+/// If the bindings after `where` do not parse, it is left unqualified.
+std::unique_ptr<AST::Expression> AST::WhereExpr::parseQualified(const Token*& source)
 {
     auto expression = Parser<AST::Expression>::parse(source);
+    if (!expression) return nullptr;
 
-    remove_leading_whitespace(source);
-    if (!match_exact_string(source, "where")) return nullptr;
+    const Token* rest = source;
+    if (!match(rest, Token::Kind::Name, "where")) return expression;
 
     do {
-        auto binding = Parser<AST::Binding>::parse(source);
-        if (!binding) return nullptr;
+        auto binding = Parser<AST::Binding>::parse(rest);
+        if (!binding) return expression;
 
         expression = std::make_unique<AST::WhereExpr>(std::move(expression), std::move(binding));
+    } while (match(rest, Token::Kind::Comma));
 
-        remove_leading_whitespace(source);
-    } while (match_exact_string(source, ","));
-
-    return dynamic_pointer_cast<AST::WhereExpr>(std::move(expression));
+    source = rest;
+    return expression;
 }
 
-std::unique_ptr<AST::LetExpr> AST::LetExpr::parse(const char*& source)
+std::unique_ptr<AST::LetExpr> AST::LetExpr::parse(const Token*& source)
 {
-    remove_leading_whitespace(source);
-    if (!match_exact_string(source, "let")) return nullptr;
+    if (!match(source, Token::Kind::Name, "let")) return nullptr;
 
     auto binding = Parser<AST::Binding>::parse(source);
     if (!binding) return nullptr;
 
-    remove_leading_whitespace(source);
-    if (!match_exact_string(source, "in")) return nullptr;
+    if (!match(source, Token::Kind::Name, "in")) return nullptr;
 
     auto expr = Parser<AST::Expression>::parse(source);
     if (!expr) return nullptr;
@@ -159,7 +180,7 @@ std::unique_ptr<AST::LetExpr> AST::LetExpr::parse(const char*& source)
     return std::make_unique<AST::LetExpr>(std::move(binding), std::move(expr));
 }
 
-std::unique_ptr<AST::SimpleExpr> AST::SimpleExpr::parse(const char*& source)
+std::unique_ptr<AST::SimpleExpr> AST::SimpleExpr::parse(const Token*& source)
 {
     if (auto name = Parser<AST::Name>::parse(source))
         return name;
@@ -173,102 +194,65 @@ std::unique_ptr<AST::SimpleExpr> AST::SimpleExpr::parse(const char*& source)
     return nullptr;
 }
 
-std::unique_ptr<AST::Name> AST::Name::parse(const char*& source)
+std::unique_ptr<AST::Name> AST::Name::parse(const Token*& source)
 {
-    remove_leading_whitespace(source);
-
-    const static std::string valid_name_chars(
-        "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
-        "abcdefghijklmnopqrstuvwxyz"
-        "0123456789"
-        "_:"
-    );
-
-    const char* name_begin = source;
-    while (*source != 0)
-    {
-        bool is_valid_name_char = false;
-
-        for (const auto& c : valid_name_chars)
-        if (*source == c)
-        {
-            is_valid_name_char = true;
-            break;
-        }
+    if (source->kind != Token::Kind::Name) return nullptr;
 
-        if (!is_valid_name_char) break;
-        source++;
-    }
-    const char* name_end = source;
-
-    if (name_begin == name_end) return nullptr;
-
-    std::string name(name_begin, name_end);
-
-    if (keywords.contains(name)) return nullptr;
+    Symbol name(std::string(source->text));
+    if (isKeyword(name)) return nullptr;
 
+    source++;
     return std::make_unique<AST::Name>(name);
 }
 
-std::unique_ptr<AST::String> AST::String::parse(const char*& source)
+std::unique_ptr<AST::String> AST::String::parse(const Token*& source)
 {
-    remove_leading_whitespace(source);
-    if (!match_exact_string(source, "\"")) return nullptr;
-
-    const char* str_begin = source;
-    while (*source != '\"')
-    {
-        if (*source == 0) return nullptr;
-        source++;
-    }
-    const char* str_end = source;
-
-    if (!match_exact_string(source, "\"")) return nullptr;
+    if (source->kind != Token::Kind::String) return nullptr;
 
-    std::string str(str_begin, str_end);
+    std::string str(source->text);
+    source++;
     return std::make_unique<AST::String>(str);
 }
 
-std::unique_ptr<AST::BracketExpr> AST::BracketExpr::parse(const char*& source)
+std::unique_ptr<AST::BracketExpr> AST::BracketExpr::parse(const Token*& source)
 {
-    remove_leading_whitespace(source);
+    if (match(source, Token::Kind::Dollar))
+    {
+        auto expr = Parser<AST::Expression>::parse(source);
+        if (!expr) return nullptr;
 
-    if (match_exact_string(source, "$"))
-        return std::make_unique<AST::BracketExpr>(Parser<AST::Expression>::parse(source));
+        return std::make_unique<AST::BracketExpr>(std::move(expr));
+    }
 
-    if (!match_exact_string(source, "(")) return nullptr;
+    if (!match(source, Token::Kind::Open)) return nullptr;
 
     auto expr = Parser<Expression>::parse(source);
     if (!expr) return nullptr;
 
-    remove_leading_whitespace(source);
-    if (!match_exact_string(source, ")")) return nullptr;
+    if (!match(source, Token::Kind::Close)) return nullptr;
 
     return std::make_unique<AST::BracketExpr>(std::move(expr));
 }
 
-std::unique_ptr<AST::Binding> AST::Binding::parse(const char*& source)
+std::unique_ptr<AST::Binding> AST::Binding::parse(const Token*& source)
 {
     auto name = Parser<AST::Name>::parse(source);
     if (!name) return nullptr;
 
-    remove_leading_whitespace(source);
-    if (!match_exact_string(source, "=")) return nullptr;
+    if (!match(source, Token::Kind::Equals)) return nullptr;
 
-    std::unique_ptr<AST::Expression> expr = Parser<AST::WhereExpr>::parse(source);
-    if (!expr) expr = Parser<AST::Expression>::parse(source);
+    auto expr = AST::WhereExpr::parseQualified(source);
     if (!expr) return nullptr;
 
     return std::make_unique<AST::Binding>(*name, std::move(expr));
 }
 
-std::unique_ptr<AST::Mapping> AST::Mapping::parse(const char*& source)
+std::unique_ptr<AST::Mapping> AST::Mapping::parse(const Token*& source)
 {
     auto name = Parser<AST::Name>::parse(source);
     if (!name) return nullptr;
 
-    remove_leading_whitespace(source);
-    if (!match_exact_string(source, "->")) return nullptr;
+    if (!match(source, Token::Kind::Arrow)) return nullptr;
 
     auto expr = Parser<AST::Expression>::parse(source);
     if (!expr) return nullptr;
@@ -0,0 +1,42 @@
+#include <memory>
+#include <string>
+
+#include "headers/rope.hpp"
+#include "headers/arena.hpp"
+#include "headers/util.hpp"
+
+namespace LambdaCalc
+{
+
+Rope::Segment::~Segment()
+{
+    release(std::move(left));
+    release(std::move(right));
+}
+
+Rope::Rope(std::string str)
+{ if (!str.empty()) root = make_arena_shared<Segment>(std::move(str)); }
+
+Rope operator+(const Rope& left, const Rope& right)
+{
+    if (left.empty()) return right;
+    if (right.empty()) return left;
+
+    Rope rope;
+    if (left.size() + right.size() <= Rope::maxCopiedSize)
+        rope.root = make_arena_shared<Rope::Segment>(left.flatten() + right.flatten());
+    else
+        rope.root = make_arena_shared<Rope::Segment>(left.root, right.root);
+
+    return rope;
+}
+
+std::string Rope::flatten() const
+{
+    std::string str;
+    str.reserve(size());
+    forEachSegment([&](std::string_view text) { str += text; });
+    return str;
+}
+
+}
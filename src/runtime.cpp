@@ -0,0 +1,109 @@
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "headers/runtime.hpp"
+#include "headers/arena.hpp"
+#include "headers/evaluator.hpp"
+#include "headers/machine.hpp"
+#include "headers/ir.hpp"
+
+namespace LambdaCalc::Runtime
+{
+
+using IR::Index;
+using Machine::Environment;
+using Machine::Frame;
+using Machine::Thunk;
+using Machine::Value;
+
+int run(const Module& module)
+{
+    IR::Program program;
+
+    std::vector<Symbol> names;
+    for (std::size_t i = 0; i < module.nameCount; i++)
+        names.push_back(Symbol(module.names[i]));
+
+    // The names were numbered by lambdac, so bind them to this process's symbols
+    program.nodes.assign(module.nodes, module.nodes + module.nodeCount);
+    for (auto& node : program.nodes)
+        if (node.kind == IR::Node::Kind::Lambda
+         || node.kind == IR::Node::Kind::Let
+         || node.kind == IR::Node::Kind::StrictLet)
+            node.value = names[node.value].id;
+
+    program.strings.assign(module.strings, module.strings + module.stringCount);
+
+    for (std::size_t slot = 0; slot < module.globalCount; slot++)
+        program.globals.push_back({ Symbol(module.globals[slot]) });
+
+    Arena arena;
+
+    for (std::size_t i = 0; i < module.stepCount; i++)
+    {
+        const auto& step = module.steps[i];
+        if (step.slot != IR::none)
+        {
+            program.globals[step.slot].root = step.root;
+            continue;
+        }
+
+        // As in Interpreter::run, each evaluation's garbage is released at once
+        arena.reset();
+        Arena::Scope scope(&arena);
+
+        try
+        {
+            Evaluator evaluator(program, module.blocks);
+            auto value = evaluator.evaluate(step.root);
+            std::cout << Machine::readBack(program, value)->toString() << std::endl;
+        } catch (const evaluation_error& e)
+        {
+            std::cerr << "Evaluation error: " << e.what() << std::endl;
+        }
+    }
+
+    return 0;
+}
+
+Machine::ThunkPtr Evaluator::thunk(Index term) const
+{ return make_arena_shared<Thunk>(term, env); }
+
+Machine::ThunkPtr Evaluator::closure(Index lambda) const
+{ return make_arena_shared<Thunk>(make_arena_shared<Value>(lambda, env)); }
+
+Machine::ThunkPtr Evaluator::string(std::uint32_t id) const
+{ return make_arena_shared<Thunk>(make_arena_shared<Value>(program.strings[id])); }
+
+void Evaluator::arg(Machine::ThunkPtr thunk)
+{ stack.push_back({ Frame::Kind::Argument, std::move(thunk) }); }
+
+void Evaluator::let(Machine::ThunkPtr thunk)
+{ env = make_arena_shared<Environment>(std::move(thunk), env); }
+
+void Evaluator::strictLet(Index value, Index body)
+{ sequence(thunk(value), body); }
+
+void Evaluator::enterGlobal(IR::Slot slot)
+{ enter(global(slot)); }
+
+void Evaluator::returnClosure(Index lambda)
+{ value = make_arena_shared<Value>(lambda, env); }
+
+void Evaluator::returnString(std::uint32_t id)
+{ value = make_arena_shared<Value>(program.strings[id]); }
+
+Machine::ValuePtr Evaluator::evaluate(Index root)
+{
+    term = root;
+
+    while (true)
+    {
+        if (!value) blocks[term](*this);
+        else if (!pass()) return std::move(value);
+    }
+}
+
+}
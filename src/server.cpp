@@ -0,0 +1,180 @@
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "headers/server.hpp"
+#include "headers/interpreter.hpp"
+
+namespace LambdaCalc::Server
+{
+
+namespace
+{
+
+/// @return The address of a socket at a path, or false if the path is too long for one
+bool address(const std::string& path, sockaddr_un& addr)
+{
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path))
+    {
+        errno = ENAMETOOLONG;
+        return false;
+    }
+
+    std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+    return true;
+}
+
+bool sendAll(int fd, const std::string& data)
+{
+    for (std::size_t sent = 0; sent < data.size();)
+    {
+        auto n = write(fd, data.data() + sent, data.size() - sent);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        sent += n;
+    }
+    return true;
+}
+
+/// @return Everything read from a socket until the other end stops writing to it
+std::string receiveAll(int fd)
+{
+    std::string data;
+    char buffer[4096];
+
+    while (true)
+    {
+        auto n = read(fd, buffer, sizeof(buffer));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return data;
+        data.append(buffer, n);
+    }
+}
+
+/// A reply holds what was printed to output then error, each after its length and a newline
+std::string frame(const std::string& text)
+{ return std::to_string(text.size()) + "\n" + text; }
+
+/// @return The next block of a reply from a position, or false if the reply is malformed
+bool unframe(const std::string& reply, std::size_t& position, std::string& text)
+{
+    auto newline = reply.find('\n', position);
+    if (newline == std::string::npos || newline == position) return false;
+
+    std::size_t length = 0;
+    for (auto i = position; i < newline; i++)
+    {
+        if (reply[i] < '0' || reply[i] > '9') return false;
+        length = length * 10 + (reply[i] - '0');
+    }
+
+    if (length > reply.size() - newline - 1) return false;
+    text = reply.substr(newline + 1, length);
+    position = newline + 1 + length;
+    return true;
+}
+
+/// Run the source of a request, starting from the bindings of base
+void answer(const Interpreter& base, int client)
+{
+    std::istringstream input(receiveAll(client));
+    std::ostringstream output, error;
+
+    {
+        StreamInterpreter interpreter(input, output, error);
+        interpreter.inherit(base);
+        interpreter.run();
+    }
+
+    sendAll(client, frame(output.str()) + frame(error.str()));
+    close(client);
+}
+
+}
+
+int serve(const Interpreter& base, const std::string& path)
+{
+    sockaddr_un addr;
+    if (!address(path, addr))
+    {
+        std::cerr << "Server Error: Socket path is too long: \"" << path << "\"" << std::endl;
+        return 1;
+    }
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0)
+    {
+        std::cerr << "Server Error: " << std::strerror(errno) << std::endl;
+        return 1;
+    }
+
+    // A socket left behind by a server that was killed would stop this one binding
+    unlink(path.c_str());
+    if (::bind(listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || listen(listener, SOMAXCONN) != 0)
+    {
+        std::cerr << "Server Error: Failed to listen on \"" << path << "\": " << std::strerror(errno) << std::endl;
+        close(listener);
+        return 1;
+    }
+
+    // A client that disconnects before its reply is sent must not kill the server
+    std::signal(SIGPIPE, SIG_IGN);
+
+    while (true)
+    {
+        int client = accept(listener, nullptr, nullptr);
+        if (client < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            std::cerr << "Server Error: " << std::strerror(errno) << std::endl;
+            close(listener);
+            return 1;
+        }
+
+        std::thread([&base, client]() { answer(base, client); }).detach();
+    }
+}
+
+int request(const std::string& path, const std::string& source, std::ostream& output, std::ostream& error)
+{
+    sockaddr_un addr;
+    int server = -1;
+    if (address(path, addr)) server = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if (server < 0 || connect(server, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0)
+    {
+        error << "Client Error: Failed to connect to \"" << path << "\": " << std::strerror(errno) << std::endl;
+        if (server >= 0) close(server);
+        return 1;
+    }
+
+    // The server runs the request once it has all of it
+    bool sent = sendAll(server, source);
+    shutdown(server, SHUT_WR);
+    std::string reply = sent ? receiveAll(server) : "";
+    close(server);
+
+    std::string out, err;
+    std::size_t position = 0;
+    if (!unframe(reply, position, out) || !unframe(reply, position, err))
+    {
+        error << "Client Error: The server at \"" << path << "\" did not reply" << std::endl;
+        return 1;
+    }
+
+    output << out << std::flush;
+    error << err << std::flush;
+    return 0;
+}
+
+}
@@ -0,0 +1,56 @@
+#include <deque>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "headers/symbol.hpp"
+
+namespace LambdaCalc
+{
+
+/// The names are kept in a deque, so references to them stay valid as it grows
+struct Interner
+{
+    std::mutex mutex;
+    std::deque<std::string> names { "" };
+    std::unordered_map<std::string_view, Symbol::Id> ids { { names[0], 0 } };
+};
+
+static Interner& interner()
+{
+    static Interner interner;
+    return interner;
+}
+
+Symbol::Symbol(const std::string& name)
+{
+    auto& table = interner();
+    std::lock_guard lock(table.mutex);
+
+    if (auto it = table.ids.find(name); it != table.ids.end())
+    {
+        id = it->second;
+        return;
+    }
+
+    id = table.names.size();
+    table.names.push_back(name);
+    table.ids[table.names.back()] = id;
+}
+
+const std::string& Symbol::str() const
+{
+    auto& table = interner();
+    std::lock_guard lock(table.mutex);
+    return table.names[id];
+}
+
+std::size_t Symbol::count()
+{
+    auto& table = interner();
+    std::lock_guard lock(table.mutex);
+    return table.names.size();
+}
+
+}